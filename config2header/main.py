@@ -0,0 +1,478 @@
+'''
+This script generates the firmware configuration header nic_config.h from an experiment config.json. The NIC queue
+layout follows the NIC simulator: pass-through IPs share one early demux queue and every buffer gets its own queue.
+The port of an IP is its last byte, just like in trace2blob.
+'''
+
+import argparse
+import json
+import sys
+
+PASS_THROUGH = 'pass_through'
+
+# Defaults used when the optional "firmware" section does not say otherwise.
+TOP_PRIORITY = 20
+PASS_THROUGH_DEPTH = 0x100
+BUFFER_DEPTH = 0x400
+SOCK_DEPTH = 0x100
+SPARE_SOCKS = 2
+
+# Socket queue overflow policies, NET_OVERFLOW_* in the firmware.
+OVERFLOW = {'drop_newest': 0, 'drop_oldest': 1}
+
+# Task placement presets. "single" keeps the driver and all workers on core 0 and the traffic generator on core 1.
+# "smp" moves the GPIO ISR, the net tasks and the second half of the workers to core 1 and the traffic generator to
+# core 0. The generator sleeps between IRQs, so it keeps the top priority. Cores of single queues and workers can be
+# overridden.
+WORKER_PRIORITY = 14
+AFFINITY = {
+    'single': {'isr': 0, 'net': 0, 'traffic': 1, 'traffic_priority': '(configMAX_PRIORITIES - 1)'},
+    'smp': {'isr': 1, 'net': 1, 'traffic': 0, 'traffic_priority': '(configMAX_PRIORITIES - 1)'},
+}
+
+# Interrupt moderation settings of a buffer, in the order of coalesce_cfg_t.
+COALESCE_KEYS = ('packet_limit', 'packet_time_limit', 'absolute_time_limit', 'absolute_time_limit_offset',
+                 'capacity')
+
+# Packets a NIC queue can hold on the device, NET_COALESCE_RING in the firmware.
+COALESCE_RING = 0x80
+
+# Packets a worker takes off its sockets at once, WORKER_BATCH in the firmware.
+WORKER_BATCH = 32
+
+# Replay speed factors are passed to the firmware in permille. A search starts at the replay speed and multiplies it
+# by the step after every pass that had no drops and stayed within the latency bound, 0 disables the bound.
+SPEED_UNIT = 1000
+REPLAY = {'speed': 1.0, 'step': 1.25, 'max_speed': 64.0, 'max_latency_us': 0}
+
+# Ports a single task waits on with net_poll(), one notification bit per socket of the 32 bit notification value
+# leaves room for 31 sockets.
+POLL_MAX = 31
+
+# Poll workers serve a group of ports from one task, instead of one worker per port. Suits many low-rate ports.
+POLL = {'priority': WORKER_PRIORITY, 'core': 0}
+
+# Shared worker pool, used instead of one worker per port if enabled. Pool workers default to one per core. A port is
+# at home with the pool worker on the core of its own worker, taking turns if a core has several. Idle pool workers
+# steal from ports with at least steal_min packets queued, preferring ports at home on their own core.
+POOL = {'workers': 2, 'priority': WORKER_PRIORITY, 'steal_min': 1}
+
+# Periodic tasks standing in for control loops, measured under the replayed load. Every activation spends wcet_us on
+# arithmetic and should finish within deadline_us, by default the period.
+PERIODIC = {'priority': WORKER_PRIORITY + 1, 'core': 0}
+
+# Per port workload models, WORKLOAD_* in the firmware. Ports without a workload keep the original binomial load.
+WORKLOAD_MODELS = {'binom': 0, 'fixed': 1, 'table': 2, 'memory': 3}
+
+
+def ip_to_port(ip: str) -> int:
+    return int(ip.split('.')[-1])
+
+
+def build(config: dict) -> dict:
+    firmware = config.get('firmware', {})
+    queue_overrides = firmware.get('queues', {})
+    port_overrides = firmware.get('ports', {})
+    sock_overflow = firmware.get('sock_overflow', 'drop_newest')
+    affinity_name = firmware.get('affinity', 'single')
+    affinity = AFFINITY[affinity_name]
+    worker_overrides = firmware.get('workers', {})
+    replay = dict(REPLAY, **firmware.get('replay', {}))
+    workload_settings = firmware.get('workloads', {})
+    pool_settings = dict(POOL, **firmware.get('pool', {}))
+    periodic_settings = firmware.get('periodic', [])
+    poll_settings = firmware.get('poll', [])
+
+    queues = []
+    ports = []
+
+    def add_queue(name, ips, depth, early_demux, moderation):
+        override = queue_overrides.get(name, {})
+        index = len(queues)
+        queues.append({
+            'name': name,
+            'task': 'net-pt' if name == PASS_THROUGH else 'net-' + name[:11],
+            'priority': override.get('priority', TOP_PRIORITY - index),
+            'depth': override.get('depth', depth),
+            'early_demux': int(override.get('early_demux', early_demux)),
+            'core': override.get('core', affinity['net']),
+            # Unset limits of the NIC simulator disable the trigger.
+            'coalesce': [moderation.get(key) or 0 for key in COALESCE_KEYS],
+        })
+        for ip in ips:
+            port = ip_to_port(ip)
+            port_override = port_overrides.get(str(port), {})
+            ports.append({
+                'port': port,
+                'queue': index,
+                'depth': port_override.get('depth', SOCK_DEPTH),
+                'overflow': OVERFLOW[port_override.get('overflow', sock_overflow)],
+            })
+
+    if config.get('pass_through_ips'):
+        add_queue(PASS_THROUGH, config['pass_through_ips'], PASS_THROUGH_DEPTH, 1, {'packet_limit': 1})
+    for buf in config.get('buffers', []):
+        add_queue(buf['name'], buf['ips'], BUFFER_DEPTH, 0, buf)
+
+    # Packets of unknown ports still need a queue to be dropped from.
+    if not queues:
+        add_queue('default', [], BUFFER_DEPTH, 0, {'packet_limit': 1})
+
+    # One worker per listed port, ordered like the ports. With "smp" the second half runs on core 1.
+    workers = []
+    for index, p in enumerate(ports):
+        override = worker_overrides.get(str(p['port']), {})
+        default_core = int(affinity_name == 'smp' and 2 * index >= len(ports))
+        workers.append({
+            'name': 'WRK-%d' % (index + 1),
+            'port': p['port'],
+            'priority': override.get('priority', WORKER_PRIORITY - index),
+            'core': override.get('core', default_core),
+            'deadline_us': override.get('deadline_us', 0),
+        })
+
+    poll = []
+    poll_groups = [-1] * len(workers)
+    for index, group in enumerate(poll_settings):
+        group = dict(POLL, **group)
+        poll.append({
+            'name': 'POLL-%d' % (index + 1),
+            'priority': group['priority'],
+            'core': group['core'],
+            'ports': group['ports'],
+        })
+        for w_index, w in enumerate(workers):
+            if w['port'] in group['ports']:
+                poll_groups[w_index] = index
+
+    pool_cores = pool_settings.get('cores', [i % 2 for i in range(pool_settings['workers'])])
+    pool = [{
+        'name': 'POOL-%d' % (index + 1),
+        'priority': pool_settings['priority'],
+        'core': pool_cores[index],
+    } for index in range(pool_settings['workers'])]
+    pool_homes = []
+    for index, w in enumerate(workers):
+        on_core = [i for i, p in enumerate(pool) if p['core'] == w['core']]
+        home = on_core[sum(h in on_core for h in pool_homes) % len(on_core)] if on_core else index % len(pool)
+        pool_homes.append(pool_settings.get('homes', {}).get(str(w['port']), home))
+
+    periodic = []
+    for index, task in enumerate(periodic_settings):
+        task = dict(PERIODIC, **task)
+        periodic.append({
+            'name': 'RT-%d' % (index + 1),
+            'period_us': task['period_us'],
+            'wcet_us': task['wcet_us'],
+            'deadline_us': task.get('deadline_us', task['period_us']),
+            'priority': task['priority'],
+            'core': task['core'],
+        })
+
+    # Table-driven ports draw their cost from weighted rows, all ports share one row table.
+    workloads = []
+    dist = []
+    for port, w in sorted(workload_settings.items(), key=lambda item: int(item[0])):
+        model = w.get('model', 'fixed')
+        rows = []
+        if model == 'table':
+            rows = list(zip(w['cycles'], w.get('weights', [1] * len(w['cycles']))))
+        workloads.append({
+            'port': int(port),
+            'model': WORKLOAD_MODELS[model],
+            'cycles': 0 if model == 'table' else w.get('cycles', 0),
+            'dist_first': len(dist),
+            'dist_count': len(rows),
+        })
+        dist += rows
+
+    return {
+        'queues': queues,
+        'workers': workers,
+        'isr_core': firmware.get('isr_core', affinity['isr']),
+        'traffic_core': firmware.get('traffic_core', affinity['traffic']),
+        'traffic_priority': firmware.get('traffic_priority', affinity['traffic_priority']),
+        'replay': replay,
+        'poll': poll,
+        'poll_groups': poll_groups,
+        'pool': pool,
+        'pool_homes': pool_homes,
+        'pool_steal_min': pool_settings['steal_min'],
+        'periodic': periodic,
+        'workloads': workloads,
+        'workload_dist': dist,
+        'ports': ports,
+        'sock_depth': firmware.get('sock_depth', SOCK_DEPTH),
+        'sock_overflow': OVERFLOW[sock_overflow],
+    }
+
+
+def continued(line: str) -> str:
+    return line.ljust(40) + '\\'
+
+
+def render(layout: dict, source: str, coalesce: bool = False, text_export: bool = False,
+           histograms: bool = False, search: bool = False, edf: bool = False,
+           pool: bool = False, prio_boost: bool = False) -> str:
+    queues = layout['queues']
+    replay = layout['replay']
+    ports = layout['ports']
+    sock_depth = layout['sock_depth']
+    arena_slots = sum(q['depth'] for q in queues) + sum(p['depth'] for p in ports) + SPARE_SOCKS * sock_depth
+    # Port workers of polled ports never start, so this is an upper bound of the batches in flight.
+    tasks = len(layout['pool']) if pool else len(layout['workers']) + len(layout['poll'])
+    held = COALESCE_RING * len(queues) if coalesce else 0
+    pbuf_count = arena_slots + held + len(queues) + tasks * WORKER_BATCH
+    # Port demux table of at least twice the ports that can be bound, the listed ones and those of the spare sockets.
+    port_bits = max(1, (2 * (len(ports) + SPARE_SOCKS) - 1).bit_length())
+
+    out = []
+    out.append('#ifndef __NIC_CONFIG__')
+    out.append('#define __NIC_CONFIG__')
+    out.append('\n')
+    out.append('/*')
+    out.append(' * Generated by config2header from %s, do not edit.' % source)
+    out.append(' */')
+    out.append('')
+    out.append('#define NIC_QUEUE_COUNT         %d' % len(queues))
+    out.append('')
+    out.append('/*')
+    out.append(' * Per queue: { task name, net task priority, ingress queue depth,')
+    out.append(' *              early demux, net task core }')
+    out.append(' *')
+    out.append(' * Every NIC queue is served by its own ingress queue and net task. Early')
+    out.append(' * demux is meant for pass-through queues, their packets are put into the')
+    out.append(' * socket queue directly from the ISR.')
+    out.append(' */')
+    out.append(continued('#define NIC_QUEUE_TABLE {'))
+    for q in queues:
+        out.append(continued('    { "%s", %d, 0x%x, %d, %d },' % (
+            q['task'], q['priority'], q['depth'], q['early_demux'], q['core'])))
+    out.append('}')
+    out.append('')
+    out.append('/*')
+    out.append(' * Per port: { port, queue, socket queue depth, overflow policy }. Ports')
+    out.append(' * not listed land in NIC_DEFAULT_QUEUE and get NIC_SOCK_DEPTH and')
+    out.append(' * NIC_SOCK_OVERFLOW. Overflow policy 0 drops the newest, 1 the oldest')
+    out.append(' * packet.')
+    out.append(' *')
+    out.append(' * The port demux table has 2^NIC_PORT_BITS slots, at least twice the')
+    out.append(' * listed ports and the ports of the spare sockets.')
+    out.append(' */')
+    out.append('#define NIC_PORT_COUNT          %d' % len(ports))
+    out.append('#define NIC_PORT_BITS           %d' % port_bits)
+    out.append(continued('#define NIC_PORT_TABLE {'))
+    for p in ports:
+        out.append(continued('    { %d, %d, 0x%x, %d },' % (p['port'], p['queue'], p['depth'], p['overflow'])))
+    out.append('}')
+    out.append('')
+    out.append('/*')
+    out.append(' * Per queue: { packet limit, packet time limit, absolute time limit,')
+    out.append(' *              absolute time limit offset, capacity }, times in')
+    out.append(' *              microseconds, capacity 0 for NET_COALESCE_RING.')
+    out.append(' *')
+    out.append(' * Interrupt moderation of the NIC simulator. With NIC_COALESCE set the')
+    out.append(' * firmware moderates on the device and the trace holds raw arrivals,')
+    out.append(' * otherwise the table is unused and the trace holds the simulated IRQs.')
+    out.append(' */')
+    out.append('#define NIC_COALESCE            %d' % int(coalesce))
+    out.append(continued('#define NIC_COALESCE_TABLE {'))
+    for q in queues:
+        out.append(continued('    { %d, %d, %d, %d, %d },' % tuple(q['coalesce'])))
+    out.append('}')
+    out.append('')
+    out.append('#define NIC_DEFAULT_QUEUE       (NIC_QUEUE_COUNT - 1)')
+    out.append('#define NIC_SOCK_DEPTH          0x%x' % sock_depth)
+    out.append('#define NIC_SOCK_OVERFLOW       %d' % layout['sock_overflow'])
+    out.append('')
+    out.append('/*')
+    out.append(' * Per worker: { task name, port, priority, core, deadline in us }')
+    out.append(' *')
+    out.append(' * Packets of a port with a deadline count as missed if their worker')
+    out.append(' * finishes them later than that after they were sent. With NIC_EDF the')
+    out.append(' * worker priorities are handed out by earliest absolute deadline instead')
+    out.append(' * of being fixed.')
+    out.append(' *')
+    out.append(' * The GPIO ISR is installed on NIC_ISR_CORE. The traffic generator and')
+    out.append(' * its timer ISR run on NIC_TRAFFIC_CORE, the generator sleeps between')
+    out.append(' * IRQs and only delays the tasks of its core while it arms the timer.')
+    out.append(' */')
+    out.append('#define NIC_WORKER_COUNT        %d' % len(layout['workers']))
+    out.append(continued('#define NIC_WORKER_TABLE {'))
+    for w in layout['workers']:
+        out.append(continued('    { "%s", %d, %d, %d, %d },' % (
+            w['name'], w['port'], w['priority'], w['core'], w['deadline_us'])))
+    out.append('}')
+    out.append('#define NIC_EDF                 %d' % int(edf))
+    out.append('')
+    out.append('/*')
+    out.append(' * Per poll worker: { task name, priority, core }')
+    out.append(' * Per worker of NIC_WORKER_TABLE: index of the poll worker serving its')
+    out.append(' * port instead, -1 if it has a worker of its own')
+    out.append(' */')
+    out.append('#define NIC_POLL_COUNT          %d' % len(layout['poll']))
+    out.append(continued('#define NIC_POLL_TABLE {'))
+    for p in layout['poll']:
+        out.append(continued('    { "%s", %d, %d },' % (p['name'], p['priority'], p['core'])))
+    if not layout['poll']:
+        out.append(continued('    { 0 },'))
+    out.append('}')
+    out.append('#define NIC_POLL_GROUP_TABLE    { %s }' % ', '.join(str(g) for g in layout['poll_groups']))
+    out.append('')
+    out.append('/*')
+    out.append(' * Per pool worker: { task name, priority, core }')
+    out.append(' * Per worker of NIC_WORKER_TABLE: index of the pool worker its port is')
+    out.append(' * at home with')
+    out.append(' *')
+    out.append(' * With NIC_POOL the pool workers serve all ports instead of one worker')
+    out.append(' * per port. Idle pool workers take packets from ports with at least')
+    out.append(' * NIC_POOL_STEAL_MIN queued, ports at home on their own core first.')
+    out.append(' */')
+    out.append('#define NIC_POOL                %d' % int(pool))
+    out.append('#define NIC_POOL_COUNT          %d' % len(layout['pool']))
+    out.append(continued('#define NIC_POOL_TABLE {'))
+    for p in layout['pool']:
+        out.append(continued('    { "%s", %d, %d },' % (p['name'], p['priority'], p['core'])))
+    out.append('}')
+    out.append('#define NIC_POOL_HOME_TABLE     { %s }' % ', '.join(str(h) for h in layout['pool_homes']))
+    out.append('#define NIC_POOL_STEAL_MIN      %d' % layout['pool_steal_min'])
+    out.append('')
+    out.append('/*')
+    out.append(' * With NIC_PRIO_BOOST every net task runs one priority above the highest')
+    out.append(' * priority worker waiting on a port of its queue and drops to a low')
+    out.append(' * priority while none waits, instead of its priority in NIC_QUEUE_TABLE.')
+    out.append(' */')
+    out.append('#define NIC_PRIO_BOOST          %d' % int(prio_boost))
+    out.append('')
+    out.append('#define NIC_ISR_CORE            %d' % layout['isr_core'])
+    out.append('#define NIC_TRAFFIC_CORE        %d' % layout['traffic_core'])
+    out.append('#define NIC_TRAFFIC_PRIORITY    %s' % layout['traffic_priority'])
+    out.append('')
+    out.append('/*')
+    out.append(' * Packet buffer pointer slots of the static queue arena: all ingress')
+    out.append(' * queues, all listed ports and %d spare sockets of NIC_SOCK_DEPTH.' % SPARE_SOCKS)
+    out.append(' */')
+    out.append('#define NIC_ARENA_SLOTS         %d' % arena_slots)
+    out.append('')
+    out.append('/*')
+    out.append(' * Packet buffers: one per arena slot, per packet held on the device and')
+    out.append(' * per packet in flight in a net task or a worker batch, so that drops are')
+    out.append(' * decided by the queue depths and overflow policies, never by the pool.')
+    out.append(' */')
+    out.append('#define NIC_PBUF_COUNT          %d' % pbuf_count)
+    out.append('')
+    out.append('/*')
+    out.append(' * Per port: { port, model, cycles, first and number of distribution rows }')
+    out.append(' * Per distribution row: { cycles, weight }')
+    out.append(' *')
+    out.append(' * Workload a packet of the port costs, see workload.h. Costs are CPU')
+    out.append(' * cycles, the kernels are calibrated at boot. Other ports keep the')
+    out.append(' * original binomial load.')
+    out.append(' */')
+    out.append('#define NIC_WORKLOAD_COUNT      %d' % len(layout['workloads']))
+    out.append(continued('#define NIC_WORKLOAD_TABLE {'))
+    for w in layout['workloads']:
+        out.append(continued('    { %d, %d, %d, %d, %d },' % (
+            w['port'], w['model'], w['cycles'], w['dist_first'], w['dist_count'])))
+    if not layout['workloads']:
+        out.append(continued('    { 0 },'))
+    out.append('}')
+    out.append('#define NIC_WORKLOAD_DIST_COUNT %d' % len(layout['workload_dist']))
+    out.append(continued('#define NIC_WORKLOAD_DIST_TABLE {'))
+    for cycles, weight in layout['workload_dist']:
+        out.append(continued('    { %d, %d },' % (cycles, weight)))
+    if not layout['workload_dist']:
+        out.append(continued('    { 0 },'))
+    out.append('}')
+    out.append('')
+    out.append('/*')
+    out.append(' * Per periodic task: { task name, period, WCET and deadline in us,')
+    out.append(' *                      priority, core }')
+    out.append(' *')
+    out.append(' * Released in phase once the replay starts, see periodic.h.')
+    out.append(' */')
+    out.append('#define NIC_PERIODIC_COUNT      %d' % len(layout['periodic']))
+    out.append(continued('#define NIC_PERIODIC_TABLE {'))
+    for t in layout['periodic']:
+        out.append(continued('    { "%s", %d, %d, %d, %d, %d },' % (
+            t['name'], t['period_us'], t['wcet_us'], t['deadline_us'], t['priority'], t['core'])))
+    if not layout['periodic']:
+        out.append(continued('    { 0 },'))
+    out.append('}')
+    out.append('')
+    out.append('/*')
+    out.append(' * Results are streamed as COBS framed binary records, or as csv rows if')
+    out.append(' * set. run.py has to read the same format. NIC_EXPORT_HIST replaces the')
+    out.append(' * per packet results with per port latency and runtime histograms that')
+    out.append(' * are printed with the statistics, for runs of any length.')
+    out.append(' */')
+    out.append('#define NIC_EXPORT_TEXT         %d' % int(text_export))
+    out.append('#define NIC_EXPORT_HIST         %d' % int(histograms))
+    out.append('')
+    out.append('/*')
+    out.append(' * Replay speed factor in permille, every trace delta is divided by it.')
+    out.append(' * NIC_SEARCH repeats the trace, multiplying the speed by NIC_SEARCH_STEP')
+    out.append(' * (permille) after every pass without drops and within')
+    out.append(' * NIC_SEARCH_LATENCY_US (0 for no bound), up to NIC_SEARCH_MAX_SPEED.')
+    out.append(' * Only the passes and the sustainable rates are exported.')
+    out.append(' */')
+    out.append('#define NIC_REPLAY_SPEED        %d' % round(replay['speed'] * SPEED_UNIT))
+    out.append('#define NIC_SEARCH              %d' % int(search))
+    out.append('#define NIC_SEARCH_STEP         %d' % round(replay['step'] * SPEED_UNIT))
+    out.append('#define NIC_SEARCH_MAX_SPEED    %d' % round(replay['max_speed'] * SPEED_UNIT))
+    out.append('#define NIC_SEARCH_LATENCY_US   %d' % replay['max_latency_us'])
+    out.append('\n')
+    out.append('#endif')
+    return '\n'.join(out) + '\n'
+
+
+def main(config_json: str, out: str, coalesce: bool, text_export: bool, histograms: bool, search: bool,
+         edf: bool, pool: bool, prio_boost: bool):
+    with open(config_json) as f:
+        config = json.load(f)
+    layout = build(config)
+    if layout['replay']['speed'] <= 0 or layout['replay']['step'] <= 1:
+        sys.exit('replay speed must be positive and the search step above 1')
+    if not layout['pool'] or any(h >= len(layout['pool']) for h in layout['pool_homes']):
+        sys.exit('the pool needs a worker and every home must be one of them')
+    if any(layout['pool_homes'].count(i) > POLL_MAX for i in range(len(layout['pool']))):
+        sys.exit('a pool worker can be home to at most %d ports' % POLL_MAX)
+    if any(q['coalesce'][COALESCE_KEYS.index('capacity')] > COALESCE_RING for q in layout['queues']):
+        sys.exit('a buffer can hold at most %d packets on the device' % COALESCE_RING)
+    listed = [w['port'] for w in layout['workers']]
+    polled = [port for p in layout['poll'] for port in p['ports']]
+    if any(port not in listed for port in polled) or len(set(polled)) != len(polled):
+        sys.exit('every polled port must be a listed port of a single poll group')
+    if any(not p['ports'] or len(p['ports']) > POLL_MAX for p in layout['poll']):
+        sys.exit('a poll group needs between 1 and %d ports' % POLL_MAX)
+    if any(t['wcet_us'] <= 0 or t['wcet_us'] > t['period_us'] for t in layout['periodic']):
+        sys.exit('every periodic task needs a WCET between 0 and its period')
+    header = render(layout, config_json, coalesce, text_export, histograms, search, edf, pool, prio_boost)
+    if out:
+        with open(out, 'w') as f:
+            f.write(header)
+    else:
+        sys.stdout.write(header)
+
+
+if __name__ == '__main__':
+    # EXAMPLE: python main.py ../experiments/no_dos/setting_2/config.json --out nic_config.h
+    parser = argparse.ArgumentParser(
+        usage="%(prog)s [config_json] --out [nic_config_h] [--coalesce] [--text-export] [--histograms] "
+              "[--search] [--edf] [--pool] [--prio-boost]",
+        description="This script generates the nic_config.h firmware header from an experiment configuration."
+    )
+    parser.add_argument("config_json", help="Experiment configuration JSON")
+    parser.add_argument("--out", help="Header file name, stdout if omitted")
+    parser.add_argument("--coalesce", action="store_true", help="Moderate interrupts on the device")
+    parser.add_argument("--text-export", action="store_true", help="Stream results as csv text instead of binary")
+    parser.add_argument("--histograms", action="store_true", help="Export per port histograms instead of packets")
+    parser.add_argument("--search", action="store_true", help="Search the maximum sustainable replay speed")
+    parser.add_argument("--edf", action="store_true", help="Schedule workers by earliest deadline")
+    parser.add_argument("--pool", action="store_true", help="Serve all ports from a shared worker pool")
+    parser.add_argument("--prio-boost", action="store_true",
+                        help="Run net tasks just above their highest priority waiting worker")
+    args = parser.parse_args()
+    main(config_json=args.config_json, out=args.out, coalesce=args.coalesce, text_export=args.text_export,
+         histograms=args.histograms, search=args.search, edf=args.edf,
+         pool=args.pool, prio_boost=args.prio_boost)
@@ -0,0 +1,299 @@
+/*
+ * Host test of the interrupt moderation engine against the semantics of
+ * the NIC simulator. Runs a few hand made cases and replays the example
+ * packet trace of nic_simulator/, comparing every flush with the example
+ * interrupt trace the simulator produced from it.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coalesce.h"
+
+
+#define TEST_FLUSH_MAX      0x1000
+#define TEST_LINE_MAX       0x2000
+
+/*
+ * Buffers of nic_simulator/example_config.json. The pass-through IP
+ * interrupts on every packet, it is not moderated.
+ */
+#define TEST_BUFFERS        2
+
+static const coalesce_cfg_t test_cfg[TEST_BUFFERS] = {
+    { 0, 100000, 1000000, 0, 128 },
+    { 0, 10000, 100000, 0, 128 },
+};
+static const char* test_ips[TEST_BUFFERS][2] = {
+    { "192.168.1.1", NULL },
+    { "192.168.1.3", "192.168.1.4" },
+};
+
+
+/**
+ * struct test_flush_t - one interrupt of a moderated buffer
+ * @time        flush time in us
+ * @packets     number of packets flushed
+ * @reason      reason of the flush (COALESCE_*)
+ */
+typedef struct test_flush_t test_flush_t;
+
+struct test_flush_t {
+    uint64_t time;
+    unsigned int packets;
+    int reason;
+};
+
+static const char* test_reasons[COALESCE_REASON_COUNT] = {
+    "none", "packet_limit", "packet_timer", "absolute_timer"
+};
+
+static int test_failed;
+
+
+/**
+ * test_check() - count a failed check and report it
+ */
+static void
+test_check
+(int ok, const char* what, long got, long want)
+{
+    if (ok)
+        return;
+
+    printf("FAIL %s: got %ld, want %ld\n", what, got, want);
+    test_failed++;
+}
+
+/**
+ * test_run_until() - run the timers of `c` up to `now`
+ * @flushes     flushes are appended here
+ * @count       number of entries in `flushes`
+ *
+ * Timers expire at their deadline, before an arrival at the same time
+ * like the simulator's timeouts that were scheduled earlier.
+ */
+static void
+test_run_until
+(coalesce_t* c, uint64_t now, test_flush_t* flushes, int* count)
+{
+    uint64_t deadline;
+
+    while ((deadline = coalesce_next_deadline(c)) <= now) {
+        unsigned int pending = c->pending;
+        int reason = coalesce_expire(c, deadline);
+
+        if (reason != COALESCE_NONE && *count < TEST_FLUSH_MAX)
+            flushes[(*count)++] = (test_flush_t){ deadline, pending, reason };
+    }
+}
+
+/**
+ * test_compare() - order flushes by time, then by reason
+ */
+static int
+test_compare
+(const void* a, const void* b)
+{
+    const test_flush_t* x = a;
+    const test_flush_t* y = b;
+
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+
+    return x->reason - y->reason;
+}
+
+/**
+ * test_cases() - hand made cases of every trigger
+ */
+static void
+test_cases
+(void)
+{
+    coalesce_t c;
+    coalesce_cfg_t cfg;
+
+    /* The packet limit flushes on the arrival that reaches it. */
+    cfg = (coalesce_cfg_t){ 3, 0, 0, 0, 0 };
+    coalesce_init(&c, &cfg);
+    coalesce_start(&c, 0);
+    test_check(coalesce_arrival(&c, 10) == COALESCE_NONE, "limit 1", 0, 0);
+    test_check(coalesce_arrival(&c, 20) == COALESCE_NONE, "limit 2", 0, 0);
+    test_check(coalesce_arrival(&c, 30) == COALESCE_PACKET_LIMIT,
+        "limit 3", 0, 0);
+    test_check(c.pending == 0, "limit pending", c.pending, 0);
+
+    /* Every arrival restarts the packet timer. */
+    cfg = (coalesce_cfg_t){ 0, 100, 0, 0, 0 };
+    coalesce_init(&c, &cfg);
+    coalesce_start(&c, 0);
+    coalesce_arrival(&c, 0);
+    coalesce_arrival(&c, 50);
+    test_check(coalesce_next_deadline(&c) == 150, "packet timer",
+        (long)coalesce_next_deadline(&c), 150);
+    test_check(coalesce_expire(&c, 149) == COALESCE_NONE, "early", 0, 0);
+    test_check(coalesce_expire(&c, 150) == COALESCE_PACKET_TIMER,
+        "packet timer fires", 0, 0);
+    test_check(coalesce_next_deadline(&c) == COALESCE_DISARMED,
+        "packet timer disarmed", 0, 0);
+
+    /* The periodic flush starts after its offset and resets the timer. */
+    cfg = (coalesce_cfg_t){ 0, 100, 1000, 250, 0 };
+    coalesce_init(&c, &cfg);
+    coalesce_start(&c, 0);
+    test_check(coalesce_next_deadline(&c) == 1250, "absolute first",
+        (long)coalesce_next_deadline(&c), 1250);
+    coalesce_arrival(&c, 1200);
+    test_check(coalesce_expire(&c, 1250) == COALESCE_ABSOLUTE_TIMER,
+        "absolute fires", 0, 0);
+    test_check(coalesce_next_deadline(&c) == 2250, "absolute next",
+        (long)coalesce_next_deadline(&c), 2250);
+
+    /* An empty period raises no interrupt. */
+    test_check(coalesce_expire(&c, 2250) == COALESCE_NONE, "empty period",
+        0, 0);
+    test_check(c.flushes[COALESCE_ABSOLUTE_TIMER] == 1, "empty flushes",
+        c.flushes[COALESCE_ABSOLUTE_TIMER], 1);
+
+    /* A full buffer takes no more packets. */
+    cfg = (coalesce_cfg_t){ 0, 100, 0, 0, 2 };
+    coalesce_init(&c, &cfg);
+    coalesce_start(&c, 0);
+    coalesce_arrival(&c, 0);
+    test_check(!coalesce_full(&c), "not full", 1, 0);
+    coalesce_arrival(&c, 1);
+    test_check(coalesce_full(&c), "full", 0, 1);
+}
+
+/**
+ * test_replay() - replay the simulator example and compare the flushes
+ * @trace_csv   packet trace, "<time>,<ip>" per line
+ * @irq_csv     interrupt trace with reasons the simulator produced
+ */
+static void
+test_replay
+(const char* trace_csv, const char* irq_csv)
+{
+    static test_flush_t got[TEST_FLUSH_MAX];
+    static test_flush_t want[TEST_FLUSH_MAX];
+    coalesce_t buffers[TEST_BUFFERS];
+    char line[TEST_LINE_MAX];
+    int got_count = 0;
+    int want_count = 0;
+    uint64_t end = 0;
+    FILE* f;
+
+    if ((f = fopen(irq_csv, "r")) == NULL) {
+        printf("FAIL cannot open %s\n", irq_csv);
+        test_failed++;
+        return;
+    }
+    while (fgets(line, sizeof(line), f) && want_count < TEST_FLUSH_MAX) {
+        test_flush_t* w = &want[want_count];
+        unsigned long long time;
+        unsigned int quotes = 0;
+        int reason = COALESCE_NONE;
+
+        if (sscanf(line, "%llu,", &time) != 1)
+            continue;
+        for (char* p = line; *p; p++)
+            quotes += *p == '\'';
+        for (int r = 1; r < COALESCE_REASON_COUNT; r++) {
+            if (strstr(line, test_reasons[r]))
+                reason = r;
+        }
+
+        /* Pass-through interrupts carry no reason. */
+        if (reason == COALESCE_NONE)
+            continue;
+        *w = (test_flush_t){ time, quotes / 2, reason };
+        want_count++;
+        if (time > end)
+            end = time;
+    }
+    fclose(f);
+
+    for (int b = 0; b < TEST_BUFFERS; b++) {
+        coalesce_init(&buffers[b], &test_cfg[b]);
+        coalesce_start(&buffers[b], 0);
+    }
+
+    if ((f = fopen(trace_csv, "r")) == NULL) {
+        printf("FAIL cannot open %s\n", trace_csv);
+        test_failed++;
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char ip[32] = "";
+        unsigned long long time;
+
+        if (sscanf(line, "%llu,%31s", &time, ip) != 2)
+            continue;
+
+        for (int b = 0; b < TEST_BUFFERS; b++) {
+            coalesce_t* c = &buffers[b];
+
+            test_run_until(c, time, got, &got_count);
+            if (strcmp(ip, test_ips[b][0]) &&
+                    (!test_ips[b][1] || strcmp(ip, test_ips[b][1])))
+                continue;
+            if (coalesce_full(c))
+                continue;
+
+            unsigned int pending = c->pending + 1;
+            if (coalesce_arrival(c, time) != COALESCE_NONE &&
+                    got_count < TEST_FLUSH_MAX)
+                got[got_count++] = (test_flush_t){
+                    time, pending, COALESCE_PACKET_LIMIT
+                };
+        }
+    }
+    fclose(f);
+
+    /*
+     * The simulator stops at a fixed run time, packets held at its end
+     * raise no interrupt.
+     */
+    for (int b = 0; b < TEST_BUFFERS; b++)
+        test_run_until(&buffers[b], end, got, &got_count);
+
+    qsort(got, got_count, sizeof(test_flush_t), test_compare);
+    qsort(want, want_count, sizeof(test_flush_t), test_compare);
+
+    test_check(got_count == want_count, "replay flushes", got_count,
+        want_count);
+    for (int i = 0; i < got_count && i < want_count; i++) {
+        if (got[i].time == want[i].time && got[i].packets == want[i].packets &&
+                got[i].reason == want[i].reason)
+            continue;
+        printf(
+            "FAIL replay flush %d: got %llu/%u/%s, want %llu/%u/%s\n", i,
+            (unsigned long long)got[i].time, got[i].packets,
+            test_reasons[got[i].reason], (unsigned long long)want[i].time,
+            want[i].packets, test_reasons[want[i].reason]
+        );
+        test_failed++;
+        break;
+    }
+    printf("replay flushes=%d\n", got_count);
+}
+
+int
+main
+(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s packet_trace.csv interrupt_trace.stats.csv\n",
+            argv[0]);
+        return 2;
+    }
+
+    test_cases();
+    test_replay(argv[1], argv[2]);
+
+    printf("%s\n", test_failed ? "coalesce FAILED" : "coalesce ok");
+    return test_failed != 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Host test of the binary result frames. Checks the encoding of a fixed
+ * batch byte by byte, then writes frames of generated batches to stdout
+ * like the firmware does, followed by the same rows in the csv text
+ * format and END. frame_test.py feeds the output to result_stream.py and
+ * compares the decoded frames with the text rows.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame.h"
+
+
+#define TEST_BATCH      16
+#define TEST_BATCHES    64
+
+static int test_failed;
+
+
+/**
+ * test_fixed() - compare the frame of a fixed batch with known bytes
+ *
+ * The second row goes back in seq and sent, its deltas are negative.
+ */
+static void
+test_fixed
+(void)
+{
+    static const frame_row_t rows[] = {
+        { 2, 10, 0, 1, 2, 3, 4, 5 },
+        { 1, 5, 1, 0, 0, 0, 0, 0 },
+    };
+    static const uint8_t want[] = {
+        0x03, 0x04, 0x14, 0x0b, 0x01, 0x02, 0x03, 0x04, 0x05, 0x01, 0x09,
+        0x01, 0xf1, 0xfd,
+    };
+    uint8_t frame[FRAME_MAX(2)];
+    uint8_t cobs[FRAME_COBS_MAX(2)];
+
+    int len = frame_pack(rows, 2, frame);
+    int cobs_len = frame_cobs(frame, len, cobs);
+
+    if (cobs_len != sizeof(want) || memcmp(cobs, want, sizeof(want))) {
+        fprintf(stderr, "FAIL fixed frame:");
+        for (int i = 0; i < cobs_len; i++)
+            fprintf(stderr, " %02x", cobs[i]);
+        fprintf(stderr, "\n");
+        test_failed++;
+    }
+}
+
+/**
+ * test_row() - generated row `i`
+ *
+ * Covers wrapping and extreme deltas, drops and varints of every length,
+ * including runs of bytes without zeros longer than a COBS block.
+ */
+static frame_row_t
+test_row
+(uint32_t* state, int i)
+{
+    frame_row_t r;
+
+    *state = *state * 1664525 + 1013904223;
+    switch (i % 4) {
+    case 0:
+        r = (frame_row_t){
+            *state, *state ^ 0x80000000, 0, UINT32_MAX, UINT32_MAX - 1,
+            0xfffffff0, 0x8fffffff, 0xffffff
+        };
+        break;
+    case 1:
+        r = (frame_row_t){
+            (uint32_t)i, 0x80000000, (*state >> 30) + 1, 0, 0, 0, 0, 0
+        };
+        break;
+    default:
+        r = (frame_row_t){
+            UINT32_MAX - (uint32_t)i, (uint32_t)i * 1000, 0, *state >> 20,
+            *state >> 16, *state >> 12, *state >> 8, *state >> (i % 32)
+        };
+        break;
+    }
+
+    return r;
+}
+
+int
+main
+(void)
+{
+    static frame_row_t rows[TEST_BATCHES][TEST_BATCH];
+    uint8_t frame[FRAME_MAX(TEST_BATCH)];
+    uint8_t cobs[FRAME_COBS_MAX(TEST_BATCH)];
+    uint32_t state = 1;
+
+    test_fixed();
+
+    for (int b = 0; b < TEST_BATCHES; b++) {
+        int n = b % TEST_BATCH + 1;
+
+        for (int i = 0; i < n; i++)
+            rows[b][i] = test_row(&state, b + i);
+
+        int len = frame_pack(rows[b], n, frame);
+        int cobs_len = frame_cobs(frame, len, cobs);
+        if (len > FRAME_MAX(n) || cobs_len > FRAME_COBS_MAX(n)) {
+            fprintf(stderr, "FAIL batch %d: frame %d cobs %d\n", b, len,
+                cobs_len);
+            test_failed++;
+        }
+        fwrite(cobs, 1, cobs_len, stdout);
+        fputc(0, stdout);
+    }
+
+    /* Same columns as the text export of the firmware. */
+    for (int b = 0; b < TEST_BATCHES; b++) {
+        for (int i = 0; i < b % TEST_BATCH + 1; i++) {
+            const frame_row_t* r = &rows[b][i];
+            unsigned int received = r->drop ? 0 :
+                r->sent + r->tx_delay_ns / 1000;
+
+            printf(
+                "%u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u\n",
+                r->seq, r->sent, received, received - r->sent,
+                r->runtime_ns / 1000, r->drop, r->isr_ns, r->dequeue_ns,
+                r->wakeup_ns, r->tx_delay_ns, r->runtime_ns
+            );
+        }
+    }
+    printf("END\n");
+
+    return test_failed != 0;
+}
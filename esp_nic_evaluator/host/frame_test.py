@@ -0,0 +1,55 @@
+'''
+Round trip of the binary result frames: decodes the output of frame_test with result_stream.py and compares the rows
+of the frames with the text rows frame_test printed after them. Usage: frame_test.py ./frame_test
+'''
+
+import os
+import subprocess
+import sys
+
+sys.dont_write_bytecode = True
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+
+from result_stream import ResultStream, format_row
+
+
+def decode(data: bytes, chunk: int) -> ResultStream:
+    ''' Feeds `data` in pieces of `chunk` bytes, like reads from the serial port. '''
+    stream = ResultStream()
+    for i in range(0, len(data), chunk):
+        stream.feed(data[i:i + chunk])
+    return stream
+
+
+def main() -> int:
+    run = subprocess.run([sys.argv[1]], stdout=subprocess.PIPE)
+    if run.returncode:
+        print('frame FAILED')
+        return 1
+
+    want = decode(run.stdout, len(run.stdout)).lines
+    failed = 0
+
+    for chunk in (1, 7, 4096, len(run.stdout)):
+        stream = decode(run.stdout, chunk)
+        got = [format_row(row) for row in stream.rows]
+        if not want or not stream.done or stream.corrupted or got != want:
+            print('FAIL chunk %d: rows=%d/%d corrupted=%d done=%s' %
+                  (chunk, len(got), len(want), stream.corrupted, stream.done))
+            failed += 1
+
+    # A flipped bit costs its frame only, the reader resyncs at the next one.
+    broken = bytearray(run.stdout)
+    broken[3] ^= 0x10
+    stream = decode(bytes(broken), 4096)
+    if stream.corrupted != 1 or not stream.done or len(stream.rows) != len(want) - 1:
+        print('FAIL corrupted: rows=%d/%d corrupted=%d' % (len(stream.rows), len(want) - 1, stream.corrupted))
+        failed += 1
+
+    print('rows=%d frames=%d' % (len(want), run.stdout.count(b'\0')))
+    print('frame FAILED' if failed else 'frame ok')
+    return failed != 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
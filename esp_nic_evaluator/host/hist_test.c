@@ -0,0 +1,94 @@
+/*
+ * Host test of the log-linear histograms: bucket bounds over the whole 32
+ * bit range and percentiles that are never reported below the true value.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hist.h"
+
+
+static int test_failed;
+
+
+/**
+ * test_check() - count a failed check and report it
+ */
+static void
+test_check
+(int ok, const char* what, unsigned long got, unsigned long want)
+{
+    if (ok)
+        return;
+
+    printf("FAIL %s: got %lu, want %lu\n", what, got, want);
+    test_failed++;
+}
+
+/**
+ * test_buckets() - every bucket starts right after the previous one
+ */
+static void
+test_buckets
+(void)
+{
+    test_check(hist_bucket_low(0) == 0, "first bucket", hist_bucket_low(0), 0);
+    test_check(hist_bucket(UINT32_MAX) == HIST_BUCKETS - 1, "last bucket",
+        hist_bucket(UINT32_MAX), HIST_BUCKETS - 1);
+
+    for (int b = 1; b < HIST_BUCKETS; b++) {
+        uint32_t low = hist_bucket_low(b);
+
+        if (hist_bucket(low) != b || hist_bucket(low - 1) != b - 1) {
+            test_check(0, "bucket bounds", b, hist_bucket(low));
+            break;
+        }
+    }
+}
+
+/**
+ * test_percentiles() - percentiles against the exact ranks
+ */
+static void
+test_percentiles
+(void)
+{
+    static hist_t h;
+    static const unsigned int permille[] = { 500, 900, 990, 999, 1000 };
+
+    test_check(hist_percentile(&h, 990) == 0, "empty", hist_percentile(&h,
+        990), 0);
+
+    /* Values 1..1000, the exact percentile is the rank itself. */
+    for (uint32_t v = 1; v <= 1000; v++)
+        hist_add(&h, v);
+
+    for (unsigned int i = 0; i < sizeof(permille) / sizeof(permille[0]); i++) {
+        uint32_t got = hist_percentile(&h, permille[i]);
+
+        /* At most one bucket width, 1 / HIST_SUB of the value, above. */
+        test_check(got >= permille[i] && got - permille[i] <= permille[i] /
+            HIST_SUB, "percentile", got, permille[i]);
+    }
+    test_check(hist_percentile(&h, 1000) == 1000, "max capped",
+        hist_percentile(&h, 1000), 1000);
+
+    /* Small values have exact buckets. */
+    h = (hist_t){ 0 };
+    hist_add(&h, 3);
+    hist_add(&h, 7);
+    test_check(hist_percentile(&h, 500) == 3, "exact", hist_percentile(&h,
+        500), 3);
+}
+
+int
+main
+(void)
+{
+    test_buckets();
+    test_percentiles();
+
+    printf("%s\n", test_failed ? "hist FAILED" : "hist ok");
+    return test_failed != 0;
+}
@@ -0,0 +1,99 @@
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "esp_ipc.h"
+#endif
+
+#include "clock.h"
+
+
+#ifdef ESP_PLATFORM
+
+uint32_t clock_offset[portNUM_PROCESSORS];
+
+/**
+ * Handshake between core 0 and the core being aligned. The side waiting
+ * for a step reads its counter as soon as it sees the step.
+ */
+static volatile int clock_step;
+static volatile uint32_t clock_remote_first;
+static volatile uint32_t clock_remote_second;
+
+/**
+ * clock_remote_main() - counterpart of clock_init() on the remote core
+ *
+ * In the first half of a round core 0 signals and the remote core reads
+ * its counter, in the second half the other way round.
+ */
+static void clock_remote_main(void* arg);
+
+/**
+ * clock_round() - one round of the handshake, run by core 0
+ *
+ * Returns the remote counter minus the local one. Each half is off by the
+ * time a step takes to be seen, in opposite directions, so the mean of
+ * both halves is exact.
+ */
+static int32_t clock_round(void);
+
+
+void
+clock_init
+(void)
+{
+    for (int core = 1; core < portNUM_PROCESSORS; core++) {
+        int64_t sum = 0;
+
+        for (int i = 0; i < CLOCK_SYNC_ROUNDS; i++) {
+            clock_step = 0;
+            esp_ipc_call(core, clock_remote_main, NULL);
+            sum += clock_round();
+        }
+        clock_offset[core] = (int32_t)(sum / CLOCK_SYNC_ROUNDS);
+    }
+}
+
+static int32_t
+clock_round
+(void)
+{
+    uint32_t local_first;
+    uint32_t local_second;
+
+    while (clock_step != 1);
+
+    /* First half: the remote core reads late. */
+    local_first = esp_cpu_get_ccount();
+    clock_step = 2;
+
+    /* Second half: core 0 reads late. */
+    while (clock_step != 3);
+    local_second = esp_cpu_get_ccount();
+
+    return ((int32_t)(clock_remote_first - local_first) +
+        (int32_t)(clock_remote_second - local_second)) / 2;
+}
+
+static void
+clock_remote_main
+(void* arg)
+{
+    clock_step = 1;
+    while (clock_step != 2);
+    clock_remote_first = esp_cpu_get_ccount();
+
+    clock_remote_second = esp_cpu_get_ccount();
+    clock_step = 3;
+}
+
+#else
+
+void
+clock_init
+(void)
+{
+    /* The monotonic clock is the same on every core. */
+}
+
+#endif
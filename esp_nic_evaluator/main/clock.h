@@ -0,0 +1,104 @@
+#ifndef __CLOCK__
+#define __CLOCK__
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "soc/cpu.h"
+#include "sdkconfig.h"
+#else
+#include <time.h>
+#endif
+
+
+/*
+ * Measurement clock. On the ESP32 it counts CPU cycles, on a host build
+ * nanoseconds of the monotonic clock. Stamps are 32 bit and wrap after
+ * 2^32 / CLOCK_CYCLES_US us (about 18 s at 240 MHz), so only differences
+ * of stamps are meaningful. Dynamic frequency scaling must be disabled.
+ */
+#ifdef ESP_PLATFORM
+#define CLOCK_CYCLES_US         CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#else
+#define CLOCK_CYCLES_US         1000
+#endif
+
+/*
+ * Rounds of the handshake measuring the counter offset of a core.
+ */
+#define CLOCK_SYNC_ROUNDS       8
+
+
+#ifdef ESP_PLATFORM
+/*
+ * The cycle counters of the cores start apart, stamps of every core are
+ * moved onto the counter of core 0.
+ */
+extern uint32_t clock_offset[portNUM_PROCESSORS];
+#endif
+
+
+/**
+ * clock_init() - align the clocks of all cores
+ *
+ * Must be called on core 0 before the first stamp is taken.
+ */
+void clock_init(void);
+
+/**
+ * clock_now() - current stamp, comparable across cores
+ *
+ * Safe to be called from an ISR.
+ */
+static inline uint32_t
+clock_now
+(void)
+{
+#ifdef ESP_PLATFORM
+    return esp_cpu_get_ccount() - clock_offset[xPortGetCoreID()];
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+/**
+ * clock_us() - length of `cycles` stamp difference in us
+ */
+static inline uint32_t
+clock_us
+(uint32_t cycles)
+{
+    return cycles / CLOCK_CYCLES_US;
+}
+
+/**
+ * clock_ns() - length of `cycles` stamp difference in ns
+ */
+static inline uint32_t
+clock_ns
+(uint32_t cycles)
+{
+    return (uint64_t)cycles * 1000 / CLOCK_CYCLES_US;
+}
+
+/**
+ * clock_extend() - widen the current stamp to 64 bit
+ * @ext     last widened stamp of the caller, updated
+ *
+ * Must be called at least once per wrap of the clock.
+ */
+static inline uint64_t
+clock_extend
+(uint64_t* ext)
+{
+    *ext += (uint32_t)(clock_now() - (uint32_t)*ext);
+
+    return *ext;
+}
+
+
+#endif
@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "coalesce.h"
+
+
+/**
+ * coalesce_flush() - account a flush of all held packets
+ *
+ * Any flush empties the queue, so the packet timer has nothing to wait
+ * for anymore.
+ */
+static int coalesce_flush(coalesce_t* c, int reason);
+
+
+void
+coalesce_init
+(coalesce_t* c, const coalesce_cfg_t* cfg)
+{
+    memset(c, 0, sizeof(coalesce_t));
+    c->cfg = *cfg;
+    c->packet_deadline = COALESCE_DISARMED;
+    c->absolute_deadline = COALESCE_DISARMED;
+}
+
+void
+coalesce_start
+(coalesce_t* c, uint64_t now)
+{
+    if (c->cfg.absolute_time_limit) {
+        c->absolute_deadline = now + c->cfg.absolute_time_limit_offset
+                                    + c->cfg.absolute_time_limit;
+    }
+}
+
+int
+coalesce_arrival
+(coalesce_t* c, uint64_t now)
+{
+    c->pending++;
+
+    if (c->cfg.packet_limit && c->pending >= c->cfg.packet_limit)
+        return coalesce_flush(c, COALESCE_PACKET_LIMIT);
+
+    /* Every arrival restarts the packet timer. */
+    if (c->cfg.packet_time_limit)
+        c->packet_deadline = now + c->cfg.packet_time_limit;
+
+    return COALESCE_NONE;
+}
+
+int
+coalesce_full
+(const coalesce_t* c)
+{
+    return c->cfg.capacity && c->pending >= c->cfg.capacity;
+}
+
+int
+coalesce_expire
+(coalesce_t* c, uint64_t now)
+{
+    if (now >= c->absolute_deadline) {
+        /* Skip periods that passed unnoticed, they would flush nothing. */
+        while (c->absolute_deadline <= now)
+            c->absolute_deadline += c->cfg.absolute_time_limit;
+
+        /* The periodic flush also resets the packet timer. */
+        c->packet_deadline = COALESCE_DISARMED;
+        if (c->pending)
+            return coalesce_flush(c, COALESCE_ABSOLUTE_TIMER);
+    }
+
+    if (now >= c->packet_deadline) {
+        c->packet_deadline = COALESCE_DISARMED;
+        if (c->pending)
+            return coalesce_flush(c, COALESCE_PACKET_TIMER);
+    }
+
+    return COALESCE_NONE;
+}
+
+uint64_t
+coalesce_next_deadline
+(const coalesce_t* c)
+{
+    if (c->packet_deadline < c->absolute_deadline)
+        return c->packet_deadline;
+
+    return c->absolute_deadline;
+}
+
+static int
+coalesce_flush
+(coalesce_t* c, int reason)
+{
+    c->pending = 0;
+    c->packet_deadline = COALESCE_DISARMED;
+    c->flushes[reason]++;
+
+    return reason;
+}
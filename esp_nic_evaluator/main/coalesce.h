@@ -0,0 +1,121 @@
+#ifndef __COALESCE__
+#define __COALESCE__
+
+#include <stdint.h>
+
+
+/*
+ * Reasons for a flush, the same as in the NIC simulator.
+ */
+#define COALESCE_NONE               0
+#define COALESCE_PACKET_LIMIT       1
+#define COALESCE_PACKET_TIMER       2
+#define COALESCE_ABSOLUTE_TIMER     3
+#define COALESCE_REASON_COUNT       4
+
+#define COALESCE_DISARMED           UINT64_MAX
+
+
+/**
+ * struct coalesce_cfg_t - interrupt moderation settings of a NIC queue
+ * @packet_limit                flush once this many packets are held
+ * @packet_time_limit           flush this long after the last arrival
+ * @absolute_time_limit         flush periodically with this period
+ * @absolute_time_limit_offset  delay of the first periodic flush
+ * @capacity                    packets the queue can hold, 0 for no limit
+ *
+ * Times are in microseconds, a value of 0 disables the respective
+ * trigger. The fields mirror the buffer settings of config.json.
+ */
+typedef struct coalesce_cfg_t coalesce_cfg_t;
+
+struct coalesce_cfg_t {
+    unsigned int packet_limit;
+    unsigned int packet_time_limit;
+    unsigned int absolute_time_limit;
+    unsigned int absolute_time_limit_offset;
+    unsigned int capacity;
+};
+
+/**
+ * struct coalesce_t - interrupt moderation state of a NIC queue
+ * @cfg                 moderation settings
+ * @pending             packets held back since the last flush
+ * @packet_deadline     expiry of the packet timer or COALESCE_DISARMED
+ * @absolute_deadline   next periodic flush or COALESCE_DISARMED
+ * @flushes             number of flushes per reason
+ *
+ * The engine only does the bookkeeping, it neither holds packets nor
+ * knows about timers. The caller feeds arrivals and timer expiries with
+ * a monotonic time and flushes all held packets whenever a call returns
+ * a reason other than COALESCE_NONE. This keeps the engine free of
+ * FreeRTOS and ESP-IDF so it builds on the host as well.
+ */
+typedef struct coalesce_t coalesce_t;
+
+struct coalesce_t {
+    coalesce_cfg_t cfg;
+    unsigned int pending;
+    uint64_t packet_deadline;
+    uint64_t absolute_deadline;
+    unsigned int flushes[COALESCE_REASON_COUNT];
+};
+
+
+/**
+ * coalesce_init() - reset a moderation state
+ * @c       state to initialize
+ * @cfg     moderation settings, copied into the state
+ *
+ * All timers are disarmed until coalesce_start() is called.
+ */
+void coalesce_init(coalesce_t* c, const coalesce_cfg_t* cfg);
+
+/**
+ * coalesce_start() - anchor the periodic flush at the trace start
+ * @c       moderation state
+ * @now     time the trace starts
+ */
+void coalesce_start(coalesce_t* c, uint64_t now);
+
+/**
+ * coalesce_arrival() - account a packet arriving at the queue
+ * @c       moderation state
+ * @now     arrival time
+ *
+ * Returns COALESCE_PACKET_LIMIT if the packet fills the queue up to its
+ * packet limit and everything held has to be flushed, COALESCE_NONE
+ * otherwise. Restarts the packet timer.
+ */
+int coalesce_arrival(coalesce_t* c, uint64_t now);
+
+/**
+ * coalesce_full() - whether the queue holds as many packets as it can
+ * @c       moderation state
+ *
+ * A packet arriving at a full queue is dropped by the caller and must not
+ * be passed to coalesce_arrival().
+ */
+int coalesce_full(const coalesce_t* c);
+
+/**
+ * coalesce_expire() - run the timers of the queue
+ * @c       moderation state
+ * @now     current time
+ *
+ * Returns the reason of a flush if a timer expired with packets held,
+ * COALESCE_NONE otherwise. A periodic flush without packets raises no
+ * interrupt, the period just moves on.
+ */
+int coalesce_expire(coalesce_t* c, uint64_t now);
+
+/**
+ * coalesce_next_deadline() - time the timers have to be run next
+ * @c       moderation state
+ *
+ * Returns COALESCE_DISARMED if no timer is armed.
+ */
+uint64_t coalesce_next_deadline(const coalesce_t* c);
+
+
+#endif
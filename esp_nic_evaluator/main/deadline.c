@@ -0,0 +1,253 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "deadline.h"
+#include "clock.h"
+
+
+/**
+ * Registered and watched ports and the priorities of the registered
+ * workers in descending order.
+ */
+static deadline_t deadline[DEADLINE_MAX];
+static int deadline_band[DEADLINE_MAX];
+static int deadline_count;
+static int deadline_band_count;
+static portMUX_TYPE deadline_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Number of priority changes made in NIC_EDF mode.
+ */
+static unsigned int deadline_changes;
+
+/**
+ * deadline_add() - new entry for `port`, NULL if the table is full
+ */
+static deadline_t* deadline_add(unsigned short port, unsigned int deadline_us);
+
+/**
+ * deadline_find() - entry of the worker serving `port`, NULL if none
+ */
+static deadline_t* deadline_find(unsigned short port);
+
+/**
+ * deadline_before() - whether entry `a` ranks before entry `b`
+ *
+ * Must be called with `deadline_mux` taken.
+ */
+static int deadline_before(const deadline_t* a, const deadline_t* b);
+
+
+static deadline_t*
+deadline_add
+(unsigned short port, unsigned int deadline_us)
+{
+    deadline_t* d;
+
+    if (deadline_count >= DEADLINE_MAX)
+        return NULL;
+
+    d = &deadline[deadline_count++];
+    d->task = NULL;
+    d->port = port;
+    d->relative = deadline_us * CLOCK_CYCLES_US;
+
+    return d;
+}
+
+void
+deadline_register
+(TaskHandle_t task, unsigned short port, int prio, unsigned int deadline_us)
+{
+    deadline_t* d = deadline_add(port, deadline_us);
+    int i;
+
+    if (d == NULL)
+        return;
+
+    d->task = task;
+    d->base = prio;
+    d->prio = prio;
+
+    /* Keep the band sorted, highest priority first. */
+    for (i = deadline_band_count; i > 0 && deadline_band[i - 1] < prio; i--)
+        deadline_band[i] = deadline_band[i - 1];
+    deadline_band[i] = prio;
+
+    deadline_band_count++;
+}
+
+void
+deadline_watch
+(unsigned short port, unsigned int deadline_us)
+{
+    deadline_add(port, deadline_us);
+}
+
+static deadline_t* IRAM_ATTR
+deadline_find
+(unsigned short port)
+{
+    for (int i = 0; i < deadline_count; i++) {
+        if (deadline[i].port == port)
+            return &deadline[i];
+    }
+
+    return NULL;
+}
+
+void IRAM_ATTR
+deadline_arrive
+(unsigned short port, uint32_t sent)
+{
+    deadline_t* d = deadline_find(port);
+
+    if (d == NULL)
+        return;
+
+    portENTER_CRITICAL_SAFE(&deadline_mux);
+    if (!d->pending) {
+        d->pending = 1;
+        d->due = sent + d->relative;
+    }
+    portEXIT_CRITICAL_SAFE(&deadline_mux);
+}
+
+void
+deadline_run
+(unsigned short port, uint32_t sent)
+{
+    deadline_t* d = deadline_find(port);
+
+    /* Watched ports are not reprioritized. */
+    if (d == NULL || d->task == NULL)
+        return;
+
+    portENTER_CRITICAL(&deadline_mux);
+    d->pending = 1;
+    d->due = sent + d->relative;
+    portEXIT_CRITICAL(&deadline_mux);
+
+    deadline_update();
+}
+
+void
+deadline_done
+(unsigned short port, uint32_t sent)
+{
+    deadline_t* d = deadline_find(port);
+    uint32_t elapsed = clock_now() - sent;
+
+    if (d == NULL)
+        return;
+
+    portENTER_CRITICAL(&deadline_mux);
+    d->packets++;
+    if (d->relative && elapsed > d->relative) {
+        unsigned int lateness = clock_us(elapsed - d->relative);
+
+        d->misses++;
+        if (lateness > d->lateness_max)
+            d->lateness_max = lateness;
+    }
+    portEXIT_CRITICAL(&deadline_mux);
+}
+
+void
+deadline_idle
+(unsigned short port)
+{
+    deadline_t* d = deadline_find(port);
+
+    if (d == NULL || d->task == NULL)
+        return;
+
+    portENTER_CRITICAL(&deadline_mux);
+    d->pending = 0;
+    portEXIT_CRITICAL(&deadline_mux);
+
+    deadline_update();
+}
+
+static int
+deadline_before
+(const deadline_t* a, const deadline_t* b)
+{
+    int a_timed = a->pending && a->relative;
+    int b_timed = b->pending && b->relative;
+
+    if (a_timed != b_timed)
+        return a_timed;
+
+    /* Due stamps wrap, only their distance counts. */
+    if (a_timed)
+        return (int32_t)(a->due - b->due) < 0;
+
+    return a->base > b->base;
+}
+
+void
+deadline_update
+(void)
+{
+    int order[DEADLINE_MAX];
+    int prio[DEADLINE_MAX];
+    int ranked = 0;
+
+    if (!NIC_EDF)
+        return;
+
+    /* Watched ports keep their worker's priority, they are not ranked. */
+    portENTER_CRITICAL(&deadline_mux);
+    for (int i = 0; i < deadline_count; i++) {
+        if (deadline[i].task == NULL)
+            continue;
+
+        int k = ranked++;
+
+        while (k > 0 && deadline_before(&deadline[i], &deadline[order[k - 1]])) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+    for (int r = 0; r < ranked; r++)
+        prio[order[r]] = deadline_band[r];
+    portEXIT_CRITICAL(&deadline_mux);
+
+    /*
+     * Priorities are set outside the lock, setting one may switch tasks.
+     * A concurrent update may apply an older order, the next hook fixes it.
+     */
+    for (int i = 0; i < deadline_count; i++) {
+        if (deadline[i].task == NULL || deadline[i].prio == prio[i])
+            continue;
+        deadline[i].prio = prio[i];
+        vTaskPrioritySet(deadline[i].task, prio[i]);
+        deadline_changes++;
+    }
+}
+
+void
+deadline_print_stats
+(void)
+{
+    for (int i = 0; i < deadline_count; i++) {
+        deadline_t* d = &deadline[i];
+
+        if (!d->relative)
+            continue;
+        ets_printf(
+            "# deadline port=%u mode=%s deadline_us=%u packets=%u misses=%u "
+            "max_lateness_us=%u\n",
+            d->port, NIC_EDF && d->task ? "edf" : "fixed",
+            clock_us(d->relative),
+            d->packets, d->misses, d->lateness_max
+        );
+    }
+
+    if (NIC_EDF)
+        ets_printf("# deadline prio_changes=%u\n", deadline_changes);
+}
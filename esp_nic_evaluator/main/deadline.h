@@ -0,0 +1,124 @@
+#ifndef __DEADLINE__
+#define __DEADLINE__
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nic_config.h"
+
+
+/*
+ * One entry per worker of NIC_WORKER_TABLE. A packet meets its deadline
+ * if the worker finished it at most the relative deadline of its port
+ * after it was sent, ports with deadline 0 have none.
+ */
+#define DEADLINE_MAX        NIC_WORKER_COUNT
+
+
+/**
+ * struct deadline_t - deadline state of a worker
+ * @task            worker task handle, NULL if only misses are counted
+ * @port            port the worker serves
+ * @relative        relative deadline in clock cycles, 0 for none
+ * @base            priority of the worker in NIC_WORKER_TABLE
+ * @prio            priority the worker was last set to
+ * @pending         the worker has a packet to process
+ * @due             clock stamp of the deadline of that packet
+ * @packets         number of finished packets
+ * @misses          number of finished packets that missed their deadline
+ * @lateness_max    largest lateness of a missed packet in us
+ */
+typedef struct deadline_t deadline_t;
+
+struct deadline_t {
+    TaskHandle_t task;
+    unsigned short port;
+    uint32_t relative;
+    int base;
+    int prio;
+    int pending;
+    uint32_t due;
+    unsigned int packets;
+    unsigned int misses;
+    unsigned int lateness_max;
+};
+
+
+/**
+ * deadline_register() - account the packets of a worker to deadlines
+ * @task            worker task handle
+ * @port            port the worker serves
+ * @prio            fixed priority of the worker
+ * @deadline_us     relative deadline of the port in us, 0 for none
+ *
+ * The worker takes part in the priority band of NIC_EDF. Must be called
+ * for every worker of a single port before the first packet is sent.
+ */
+void deadline_register(TaskHandle_t task, unsigned short port, int prio,
+        unsigned int deadline_us);
+
+/**
+ * deadline_watch() - only count the deadline misses of a port
+ * @port            port served by a poll or pool worker
+ * @deadline_us     relative deadline of the port in us, 0 for none
+ *
+ * The worker keeps its fixed priority and takes no slot of the priority
+ * band. Must be called before the first packet is sent.
+ */
+void deadline_watch(unsigned short port, unsigned int deadline_us);
+
+/**
+ * deadline_arrive() - a packet was put into the socket queue of `port`
+ * @port    port of the packet
+ * @sent    clock stamp when the packet was sent
+ *
+ * An idle worker becomes ready with the deadline of the packet. This is
+ * safe to be called from an ISR.
+ */
+void IRAM_ATTR deadline_arrive(unsigned short port, uint32_t sent);
+
+/**
+ * deadline_run() - the worker of `port` starts processing a packet
+ * @port    port of the packet
+ * @sent    clock stamp when the packet was sent
+ *
+ * With NIC_EDF the workers are reprioritized to the new deadline.
+ */
+void deadline_run(unsigned short port, uint32_t sent);
+
+/**
+ * deadline_done() - the worker of `port` finished processing a packet
+ * @port    port of the packet
+ * @sent    clock stamp when the packet was sent
+ *
+ * Counts a miss if the packet finished after its deadline.
+ */
+void deadline_done(unsigned short port, uint32_t sent);
+
+/**
+ * deadline_idle() - the worker of `port` is out of packets
+ *
+ * With NIC_EDF the workers are reprioritized without it.
+ */
+void deadline_idle(unsigned short port);
+
+/**
+ * deadline_update() - give the ready workers priorities by deadline
+ *
+ * Does nothing unless NIC_EDF is set. The worker with the earliest
+ * absolute deadline gets the highest of the worker priorities of
+ * NIC_WORKER_TABLE, the next one the second highest and so on. Workers
+ * without deadline or packet follow in the order of their fixed
+ * priorities. Must not be called from an ISR.
+ */
+void deadline_update(void);
+
+/**
+ * deadline_print_stats() - print deadline misses per port to serial
+ */
+void deadline_print_stats(void);
+
+
+#endif
@@ -0,0 +1,383 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp32/rom/uart.h"
+
+#include "export.h"
+#include "frame.h"
+#include "tasks.h"
+#include "nic_config.h"
+#include "clock.h"
+#include "net.h"
+
+
+/*
+ * Results are only streamed if they are neither counted in histograms nor
+ * reduced to the pass results of a saturation search.
+ */
+#define EXPORT_RECORDS  (!NIC_EXPORT_HIST && !NIC_SEARCH)
+
+
+/**
+ * Ring of results waiting to be written out. Results are pushed by the
+ * packet ISR and the workers on any core, hence the spinlock.
+ */
+static result_t export_ring[EXPORT_RING];
+static int export_head;
+static int export_tail;
+static int export_count;
+static portMUX_TYPE export_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Results pushed, lost to a full ring and written out.
+ */
+static unsigned int export_pushed;
+static unsigned int export_overflows;
+static unsigned int export_written;
+static int export_high;
+
+/**
+ * Widened clock of the drain task, to place the stamps of results in time.
+ */
+static uint64_t export_clock;
+
+/**
+ * Results of the current trace replay.
+ */
+static export_pass_t export_current;
+
+/**
+ * Per port distributions, only used with NIC_EXPORT_HIST.
+ */
+static export_hist_t export_hist[EXPORT_HIST_PORTS];
+static const net_port_cfg_t export_port_cfg[NIC_PORT_COUNT] = NIC_PORT_TABLE;
+static unsigned int export_hist_unknown;
+
+/**
+ * export_main() - drain task loop
+ *
+ * Takes batches of results off the ring and writes them out, sleeping
+ * while the ring is empty.
+ */
+static void export_main(void* arg);
+
+/**
+ * export_hist_add() - count a result in the histograms of its port
+ *
+ * Must be called with `export_mux` taken.
+ */
+static void export_hist_add(const result_t* result);
+
+/**
+ * export_print_hist() - print the per port histograms to serial
+ */
+static void export_print_hist(void);
+
+/**
+ * export_convert() - turn the stamps of a result into times
+ * @result  result with clock stamps
+ * @row     exported row
+ * @now     widened clock stamp taken after `result` was pushed
+ */
+static void export_convert(const result_t* result, frame_row_t* row,
+        uint64_t now);
+
+/**
+ * export_ns() - ns from stamp `from` to stamp `to`, 0 if `to` is earlier
+ */
+static uint32_t export_ns(uint32_t from, uint32_t to);
+
+/**
+ * export_write_text() - write a batch of rows as csv rows
+ */
+static void export_write_text(const frame_row_t* batch, int n);
+
+/**
+ * export_write_frame() - write a batch of rows as one binary frame
+ */
+static void export_write_frame(const frame_row_t* batch, int n);
+
+
+void
+export_init
+(export_t* e)
+{
+    export_head = 0;
+    export_tail = 0;
+    export_count = 0;
+
+    /* Listed ports get their slots up front, unlisted ones cannot take them. */
+    for (int i = 0; NIC_EXPORT_HIST && i < NIC_PORT_COUNT; i++) {
+        export_hist[i].used = 1;
+        export_hist[i].port = export_port_cfg[i].port;
+    }
+
+    /* Histograms and passes are printed at the end, nothing to drain. */
+    if (!EXPORT_RECORDS)
+        return;
+
+    task_export = &e->task;
+    e->task = xTaskCreateStaticPinnedToCore(
+        (TaskFunction_t)export_main,
+        EXPORT_TASK_NAME,
+        EXPORT_STACK_SIZE,
+        NULL,
+        EXPORT_PRIORITY,
+        e->stack,
+        &e->tcb,
+        NIC_TRAFFIC_CORE
+    );
+}
+
+void IRAM_ATTR
+export_push
+(const result_t* result)
+{
+    portENTER_CRITICAL_SAFE(&export_mux);
+    export_pushed++;
+    export_current.packets++;
+    if (result->drop)
+        export_current.drops++;
+    else if (clock_us(result->received - result->sent) >
+            export_current.latency_max)
+        export_current.latency_max = clock_us(result->received - result->sent);
+
+    if (NIC_EXPORT_HIST) {
+        export_hist_add(result);
+    } else if (NIC_SEARCH) {
+        /* Only the pass results are needed. */
+    } else if (export_count < EXPORT_RING) {
+        export_ring[export_head] = *result;
+        export_head = (export_head + 1) % EXPORT_RING;
+        export_count++;
+        if (export_count > export_high)
+            export_high = export_count;
+    } else {
+        export_overflows++;
+    }
+    portEXIT_CRITICAL_SAFE(&export_mux);
+}
+
+unsigned int
+export_completed
+(void)
+{
+    return export_pushed;
+}
+
+void
+export_flush
+(void)
+{
+    while (EXPORT_RECORDS &&
+            export_written + export_overflows < export_pushed)
+        vTaskDelay(EXPORT_IDLE_MS / portTICK_PERIOD_MS);
+}
+
+void
+export_pass_start
+(void)
+{
+    portENTER_CRITICAL(&export_mux);
+    memset(&export_current, 0, sizeof(export_pass_t));
+    portEXIT_CRITICAL(&export_mux);
+}
+
+void
+export_pass
+(export_pass_t* pass)
+{
+    portENTER_CRITICAL(&export_mux);
+    *pass = export_current;
+    portEXIT_CRITICAL(&export_mux);
+}
+
+static void
+export_main
+(void* arg)
+{
+    result_t batch[EXPORT_BATCH];
+    frame_row_t rows[EXPORT_BATCH];
+
+    if (NIC_EXPORT_TEXT) {
+        ets_printf(
+            "seq, sent, recv, tx_delay, runtime, drop, isr_ns, dequeue_ns, "
+            "wakeup_ns, tx_delay_ns, runtime_ns\n"
+        );
+    }
+
+    while (true) {
+        int n = 0;
+
+        portENTER_CRITICAL(&export_mux);
+        while (n < EXPORT_BATCH && export_count > 0) {
+            batch[n++] = export_ring[export_tail];
+            export_tail = (export_tail + 1) % EXPORT_RING;
+            export_count--;
+        }
+        portEXIT_CRITICAL(&export_mux);
+
+        /* Keeps the widened clock going while the ring is empty, too. */
+        uint64_t now = clock_extend(&export_clock);
+
+        if (n == 0) {
+            vTaskDelay(EXPORT_IDLE_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        for (int i = 0; i < n; i++)
+            export_convert(&batch[i], &rows[i], now);
+
+        /* Writing blocks on the UART, so it is done outside the lock. */
+        if (NIC_EXPORT_TEXT)
+            export_write_text(rows, n);
+        else
+            export_write_frame(rows, n);
+        export_written += n;
+    }
+}
+
+static void
+export_convert
+(const result_t* result, frame_row_t* row, uint64_t now)
+{
+    /* Results are pushed well within a wrap of the clock. */
+    uint64_t sent = now - (uint32_t)((uint32_t)now - result->sent);
+
+    memset(row, 0, sizeof(frame_row_t));
+    row->seq = result->seq;
+    row->sent = sent / CLOCK_CYCLES_US;
+    row->drop = result->drop;
+    if (result->drop)
+        return;
+
+    row->isr_ns = export_ns(result->sent, result->isr);
+    row->dequeue_ns = export_ns(result->sent, result->dequeue);
+    row->wakeup_ns = export_ns(result->sent, result->wakeup);
+    row->tx_delay_ns = export_ns(result->sent, result->received);
+    row->runtime_ns = clock_ns(result->runtime);
+}
+
+static uint32_t
+export_ns
+(uint32_t from, uint32_t to)
+{
+    /* Stamps of different cores may be a few cycles apart. */
+    if ((int32_t)(to - from) < 0)
+        return 0;
+
+    return clock_ns(to - from);
+}
+
+static void
+export_write_text
+(const frame_row_t* batch, int n)
+{
+    for (int i = 0; i < n; i++) {
+        const frame_row_t* r = &batch[i];
+        /* Same as the binary reader derives them, never received is 0. */
+        unsigned int received = r->drop ? 0 : r->sent + r->tx_delay_ns / 1000;
+
+        ets_printf(
+            "%u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u\n",
+            r->seq, r->sent, received, received - r->sent,
+            r->runtime_ns / 1000, r->drop, r->isr_ns, r->dequeue_ns,
+            r->wakeup_ns, r->tx_delay_ns, r->runtime_ns
+        );
+    }
+}
+
+static void
+export_write_frame
+(const frame_row_t* batch, int n)
+{
+    static uint8_t frame[EXPORT_FRAME_MAX];
+    static uint8_t cobs[EXPORT_COBS_MAX];
+
+    int len = frame_pack(batch, n, frame);
+    int cobs_len = frame_cobs(frame, len, cobs);
+    for (int i = 0; i < cobs_len; i++)
+        uart_tx_one_char(cobs[i]);
+    uart_tx_one_char(0);
+}
+
+static void IRAM_ATTR
+export_hist_add
+(const result_t* result)
+{
+    export_hist_t* slot = NULL;
+
+    for (int i = 0; i < EXPORT_HIST_PORTS; i++) {
+        if (!export_hist[i].used) {
+            export_hist[i].used = 1;
+            export_hist[i].port = result->port;
+        }
+        if (export_hist[i].port == result->port) {
+            slot = &export_hist[i];
+            break;
+        }
+    }
+
+    if (slot == NULL) {
+        export_hist_unknown++;
+    } else if (result->drop) {
+        slot->drops++;
+    } else {
+        hist_add(&slot->latency, clock_us(result->received - result->sent));
+        hist_add(&slot->runtime, clock_us(result->runtime));
+    }
+}
+
+static void
+export_print_hist
+(void)
+{
+    static const char* kinds[] = { "latency", "runtime" };
+
+    for (int i = 0; i < EXPORT_HIST_PORTS && export_hist[i].used; i++) {
+        export_hist_t* slot = &export_hist[i];
+        const hist_t* hists[] = { &slot->latency, &slot->runtime };
+
+        for (int k = 0; k < 2; k++) {
+            const hist_t* h = hists[k];
+
+            ets_printf(
+                "# hist port=%u kind=%s packets=%u drops=%u p50_us=%u "
+                "p90_us=%u p99_us=%u p999_us=%u max_us=%u\n",
+                slot->port, kinds[k], h->total, slot->drops,
+                hist_percentile(h, 500), hist_percentile(h, 900),
+                hist_percentile(h, 990), hist_percentile(h, 999), h->max
+            );
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                if (h->count[b]) {
+                    ets_printf(
+                        "# hist port=%u kind=%s from_us=%u count=%u\n",
+                        slot->port, kinds[k], hist_bucket_low(b), h->count[b]
+                    );
+                }
+            }
+        }
+    }
+
+    if (export_hist_unknown)
+        ets_printf("# hist unknown_ports=%u\n", export_hist_unknown);
+}
+
+void
+export_print_stats
+(void)
+{
+    if (NIC_EXPORT_HIST) {
+        export_print_hist();
+        return;
+    }
+    if (NIC_SEARCH)
+        return;
+
+    ets_printf(
+        "# export ring=%d high=%d written=%u overflows=%u\n",
+        EXPORT_RING, export_high, export_written, export_overflows
+    );
+}
@@ -0,0 +1,145 @@
+#ifndef __EXPORT__
+#define __EXPORT__
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nic_config.h"
+#include "traffic.h"
+#include "hist.h"
+#include "frame.h"
+
+
+#define EXPORT_RING         0x600
+#define EXPORT_BATCH        16
+#define EXPORT_TASK_NAME    "export"
+#define EXPORT_STACK_SIZE   0x1000
+#define EXPORT_IDLE_MS      10
+
+/*
+ * Buffers of one binary frame, the format is described in frame.h.
+ */
+#define EXPORT_FRAME_MAX    FRAME_MAX(EXPORT_BATCH)
+#define EXPORT_COBS_MAX     FRAME_COBS_MAX(EXPORT_BATCH)
+
+/*
+ * Ports with their own histograms if NIC_EXPORT_HIST is set: every port of
+ * NIC_PORT_TABLE, the only ones with a worker, and the first unlisted port
+ * packets are dropped for. Results of further ports are only counted.
+ */
+#define EXPORT_HIST_PORTS   (NIC_PORT_COUNT + 1)
+
+/*
+ * The drain task runs below every worker so that writing to the UART
+ * never delays the processing of a packet.
+ */
+#define EXPORT_PRIORITY     1
+
+
+/**
+ * struct export_t - result export task struct
+ * @task            FreeRTOS task handle
+ * @tcb             FreeRTOS task tcb
+ * @stack           stack area used by the task
+ */
+typedef struct export_t export_t;
+
+struct export_t {
+    TaskHandle_t task;
+    StaticTask_t tcb;
+    StackType_t stack[EXPORT_STACK_SIZE];
+};
+
+
+/**
+ * struct export_hist_t - result distributions of a port
+ * @port            network port
+ * @used            slot is taken by `port`
+ * @drops           number of dropped packets
+ * @latency         histogram of received - sent in us
+ * @runtime         histogram of the worker runtime in us
+ */
+typedef struct export_hist_t export_hist_t;
+
+struct export_hist_t {
+    unsigned short port;
+    int used;
+    unsigned int drops;
+    hist_t latency;
+    hist_t runtime;
+};
+
+
+/**
+ * struct export_pass_t - results of one replay of the trace
+ * @packets         number of packets that got a result
+ * @drops           number of dropped packets
+ * @latency_max     largest received - sent of a received packet in us
+ */
+typedef struct export_pass_t export_pass_t;
+
+struct export_pass_t {
+    unsigned int packets;
+    unsigned int drops;
+    unsigned int latency_max;
+};
+
+
+/**
+ * export_init() - start the task streaming results over the serial line
+ * @e       export task struct
+ *
+ * Results are kept in a ring of EXPORT_RING records that the drain task
+ * writes out while the experiment runs, as binary frames or as csv rows
+ * if NIC_EXPORT_TEXT is set. If NIC_EXPORT_HIST is set no records are
+ * kept at all, results only update per port histograms that are printed
+ * with the statistics, so memory does not grow with the trace length.
+ * With NIC_SEARCH only the pass results are kept.
+ */
+void export_init(export_t* e);
+
+/**
+ * export_push() - queue the result of a received or dropped packet
+ * @result  result record, copied into the ring
+ *
+ * This is safe to be called from an ISR. If the ring is full the record
+ * is lost and counted as overflow. With NIC_EXPORT_HIST the record is
+ * counted in the histograms of its port instead.
+ */
+void IRAM_ATTR export_push(const result_t* result);
+
+/**
+ * export_completed() - number of packets that got a result so far
+ *
+ * Includes results lost to ring overflows.
+ */
+unsigned int export_completed(void);
+
+/**
+ * export_flush() - wait until every queued result has been written out
+ */
+void export_flush(void);
+
+/**
+ * export_pass_start() - start counting the results of a new trace replay
+ *
+ * Results of packets still in flight from the previous pass count
+ * against the new one.
+ */
+void export_pass_start(void);
+
+/**
+ * export_pass() - results of the current trace replay so far
+ * @pass    copy of the pass results
+ */
+void export_pass(export_pass_t* pass);
+
+/**
+ * export_print_stats() - print export statistics to serial
+ */
+void export_print_stats(void);
+
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdint.h>
+
+#include "frame.h"
+
+
+/**
+ * frame_varint() - append `value` as LEB128 varint, returns its length
+ */
+static int frame_varint(uint8_t* out, uint32_t value);
+
+/**
+ * frame_zigzag() - map a signed delta to an unsigned varint value
+ *
+ * Small deltas of either sign get small values. Shifted as unsigned, a
+ * left shift of a negative int is undefined.
+ */
+static uint32_t frame_zigzag(int32_t delta);
+
+/**
+ * frame_crc16() - CRC-16/CCITT (poly 0x1021, init 0xffff) of `buf`
+ */
+static uint16_t frame_crc16(const uint8_t* buf, int len);
+
+
+int
+frame_pack
+(const frame_row_t* rows, int n, uint8_t* out)
+{
+    uint32_t seq = 0;
+    uint32_t sent = 0;
+    int len = 0;
+
+    for (int i = 0; i < n; i++) {
+        const frame_row_t* r = &rows[i];
+
+        /* Zigzag, results arrive in completion order, not in seq order. */
+        len += frame_varint(out + len, frame_zigzag((int32_t)(r->seq - seq)));
+        len += frame_varint(out + len, frame_zigzag((int32_t)(r->sent - sent)));
+        len += frame_varint(out + len, r->drop);
+        if (!r->drop) {
+            len += frame_varint(out + len, r->isr_ns);
+            len += frame_varint(out + len, r->dequeue_ns);
+            len += frame_varint(out + len, r->wakeup_ns);
+            len += frame_varint(out + len, r->tx_delay_ns);
+            len += frame_varint(out + len, r->runtime_ns);
+        }
+        seq = r->seq;
+        sent = r->sent;
+    }
+
+    uint16_t crc = frame_crc16(out, len);
+    out[len++] = crc & 0xff;
+    out[len++] = crc >> 8;
+
+    return len;
+}
+
+int
+frame_cobs
+(const uint8_t* buf, int len, uint8_t* out)
+{
+    int code_at = 0;
+    int out_len = 1;
+    uint8_t code = 1;
+
+    for (int i = 0; i < len; i++) {
+        if (buf[i]) {
+            out[out_len++] = buf[i];
+            code++;
+        }
+
+        /* Close the block on a zero byte or when it is full. */
+        if (!buf[i] || code == 0xff) {
+            out[code_at] = code;
+            code_at = out_len++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+
+    return out_len;
+}
+
+static int
+frame_varint
+(uint8_t* out, uint32_t value)
+{
+    int len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = value;
+
+    return len;
+}
+
+static uint32_t
+frame_zigzag
+(int32_t delta)
+{
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+static uint16_t
+frame_crc16
+(const uint8_t* buf, int len)
+{
+    uint16_t crc = 0xffff;
+
+    for (int i = 0; i < len; i++) {
+        crc ^= buf[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
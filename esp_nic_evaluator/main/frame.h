@@ -0,0 +1,72 @@
+#ifndef __FRAME__
+#define __FRAME__
+
+#include <stdint.h>
+
+
+/*
+ * Binary frames carry one batch: the records, then a CRC-16/CCITT of the
+ * records in little endian, COBS encoded and terminated by a zero byte.
+ * A record is a sequence of varints: seq and sent in us as zigzag deltas
+ * to the previous record of the frame (to 0 for the first), drop, and for
+ * delivered packets the ns from sent to the ISR entry, the net dequeue,
+ * the worker wakeup and the worker receive, and the runtime in ns. Every
+ * frame decodes on its own, so a reader can resync at the next zero byte
+ * after corruption. result_stream.py is the reader.
+ */
+#define FRAME_RECORD_MAX        (8 * 5)
+#define FRAME_MAX(rows)         ((rows) * FRAME_RECORD_MAX + 2)
+#define FRAME_COBS_MAX(rows)    (FRAME_MAX(rows) + FRAME_MAX(rows) / 254 + 2)
+
+
+/**
+ * struct frame_row_t - result as it is written out
+ * @seq             packet sequence number
+ * @sent            send time in us
+ * @drop            reason the driver dropped the packet (NET_DROP_*)
+ * @isr_ns          ns from sent to the ISR entry
+ * @dequeue_ns      ns from sent to leaving the ingress queue
+ * @wakeup_ns       ns from sent to the worker wakeup
+ * @tx_delay_ns     ns from sent to the worker receive
+ * @runtime_ns      worker runtime in ns
+ *
+ * The ns fields of dropped packets are 0.
+ */
+typedef struct frame_row_t frame_row_t;
+
+struct frame_row_t {
+    uint32_t seq;
+    uint32_t sent;
+    uint32_t drop;
+    uint32_t isr_ns;
+    uint32_t dequeue_ns;
+    uint32_t wakeup_ns;
+    uint32_t tx_delay_ns;
+    uint32_t runtime_ns;
+};
+
+
+/**
+ * frame_pack() - encode a batch of rows as records followed by their CRC
+ * @rows    batch of rows
+ * @n       number of rows
+ * @out     buffer of at least FRAME_MAX(n) bytes
+ *
+ * Return: number of bytes written to `out`.
+ */
+int frame_pack(const frame_row_t* rows, int n, uint8_t* out);
+
+/**
+ * frame_cobs() - COBS encode a packed frame
+ * @buf     packed frame
+ * @len     length of `buf`
+ * @out     buffer of at least FRAME_COBS_MAX(n) bytes for `n` rows
+ *
+ * The encoded frame contains no zero byte, the caller terminates it.
+ *
+ * Return: number of bytes written to `out`.
+ */
+int frame_cobs(const uint8_t* buf, int len, uint8_t* out);
+
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __GPIO_SHIM__
+#define __GPIO_SHIM__
+
+#include <stdint.h>
+
+/*
+ * Host stand-in for the parts of driver/gpio.h the vector lines use, so
+ * vector.c and its users build and run without a board. Pins behave like
+ * GPIO_MODE_INPUT_OUTPUT with an any-edge interrupt: a level change on a
+ * pin calls its handler synchronously, as if the ISR fired right away.
+ * Wired pin pairs are looped back the same way.
+ */
+
+#define IRAM_ATTR
+#define ESP_INTR_FLAG_EDGE      (1 << 9)
+#define GPIO_SHIM_PINS          40
+
+typedef int gpio_num_t;
+typedef void (*gpio_isr_t)(void*);
+
+typedef enum {
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_INPUT_OUTPUT,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_ANYEDGE,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    int pull_up_en;
+    int pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+static uint32_t gpio_shim_level[GPIO_SHIM_PINS];
+static gpio_isr_t gpio_shim_isr[GPIO_SHIM_PINS];
+static void* gpio_shim_arg[GPIO_SHIM_PINS];
+
+/* Input pin an output pin is wired to, the pin itself if not wired. */
+static int gpio_shim_wire[GPIO_SHIM_PINS];
+
+static inline int
+gpio_shim_connect
+(gpio_num_t out, gpio_num_t in)
+{
+    gpio_shim_wire[out] = in + 1;
+    return 0;
+}
+
+static inline int
+gpio_config
+(const gpio_config_t* cfg)
+{
+    (void)cfg;
+    return 0;
+}
+
+static inline int
+gpio_set_intr_type
+(gpio_num_t pin, gpio_int_type_t type)
+{
+    (void)pin;
+    (void)type;
+    return 0;
+}
+
+static inline int
+gpio_install_isr_service
+(int flags)
+{
+    (void)flags;
+    return 0;
+}
+
+static inline int
+gpio_isr_handler_add
+(gpio_num_t pin, gpio_isr_t isr, void* arg)
+{
+    gpio_shim_isr[pin] = isr;
+    gpio_shim_arg[pin] = arg;
+    return 0;
+}
+
+static inline int
+gpio_set_level
+(gpio_num_t pin, uint32_t level)
+{
+    int in = gpio_shim_wire[pin] ? gpio_shim_wire[pin] - 1 : pin;
+
+    if (gpio_shim_level[in] != level) {
+        gpio_shim_level[in] = level;
+        if (gpio_shim_isr[in])
+            gpio_shim_isr[in](gpio_shim_arg[in]);
+    }
+    return 0;
+}
+
+#endif
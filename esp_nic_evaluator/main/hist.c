@@ -0,0 +1,65 @@
+#include "hist.h"
+
+
+void
+hist_add
+(hist_t* h, uint32_t value)
+{
+    h->count[hist_bucket(value)]++;
+    h->total++;
+    if (value > h->max)
+        h->max = value;
+}
+
+int
+hist_bucket
+(uint32_t value)
+{
+    if (value < HIST_SUB)
+        return value;
+
+    /* Position of the highest bit selects the power of two. */
+    int exp = 31 - __builtin_clz(value);
+    int sub = (value >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1);
+
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+uint32_t
+hist_bucket_low
+(int bucket)
+{
+    if (bucket < HIST_SUB)
+        return bucket;
+
+    int exp = bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    uint32_t sub = bucket % HIST_SUB;
+
+    return (1U << exp) | (sub << (exp - HIST_SUB_BITS));
+}
+
+uint32_t
+hist_percentile
+(const hist_t* h, unsigned int permille)
+{
+    /* Rank of the value, rounded up. */
+    unsigned long long rank =
+        ((unsigned long long)h->total * permille + 999) / 1000;
+    unsigned long long seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->count[i];
+        if (seen < rank)
+            continue;
+
+        /* Largest value of the bucket, no value was above the maximum. */
+        uint32_t high = i + 1 < HIST_BUCKETS ?
+            hist_bucket_low(i + 1) - 1 : UINT32_MAX;
+        return high < h->max ? high : h->max;
+    }
+
+    return 0;
+}
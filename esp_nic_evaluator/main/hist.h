@@ -0,0 +1,60 @@
+#ifndef __HIST__
+#define __HIST__
+
+#include <stdint.h>
+
+
+/*
+ * Log-linear buckets: values below 2^HIST_SUB_BITS get a bucket each,
+ * every power of two above is split into 2^HIST_SUB_BITS linear buckets,
+ * so the relative error stays below 1 / 2^HIST_SUB_BITS over the whole
+ * 32 bit range.
+ */
+#define HIST_SUB_BITS       4
+#define HIST_SUB            (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS        ((32 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+
+/**
+ * struct hist_t - log-linear histogram of 32 bit values
+ * @count       number of values per bucket
+ * @total       number of values
+ * @max         largest value
+ *
+ * The size is constant, no matter how many values are added.
+ */
+typedef struct hist_t hist_t;
+
+struct hist_t {
+    unsigned int count[HIST_BUCKETS];
+    unsigned int total;
+    uint32_t max;
+};
+
+
+/**
+ * hist_add() - count a value
+ */
+void hist_add(hist_t* h, uint32_t value);
+
+/**
+ * hist_bucket() - index of the bucket `value` is counted in
+ */
+int hist_bucket(uint32_t value);
+
+/**
+ * hist_bucket_low() - smallest value counted in bucket `bucket`
+ */
+uint32_t hist_bucket_low(int bucket);
+
+/**
+ * hist_percentile() - value below which `permille` of the values are
+ *
+ * Returns the upper bound of the bucket holding the percentile, capped at
+ * the maximum, so the percentile is never reported lower than it is. 0 for
+ * an empty histogram.
+ */
+uint32_t hist_percentile(const hist_t* h, unsigned int permille);
+
+
+#endif
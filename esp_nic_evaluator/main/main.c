@@ -10,6 +10,12 @@
 #include "net.h"
 #include "worker.h"
 #include "traffic.h"
+#include "export.h"
+#include "workload.h"
+#include "clock.h"
+#include "usage.h"
+#include "deadline.h"
+#include "periodic.h"
 
 
 static const char* TAG = "RXQ_MUX_BOOT";
@@ -18,35 +24,130 @@ static const char* TAG = "RXQ_MUX_BOOT";
 /*
  * Instanciate workers.
  */
-static worker_t worker[4];
-//static worker_t obs[1];
+static worker_t worker[NIC_WORKER_COUNT];
+static const worker_cfg_t worker_cfg[NIC_WORKER_COUNT] = NIC_WORKER_TABLE;
+
+/*
+ * Instanciate the poll workers and the ports they serve.
+ */
+static worker_t poll_worker[NIC_POLL_COUNT + 1];
+static const pool_cfg_t poll_cfg[NIC_POLL_COUNT + 1] = NIC_POLL_TABLE;
+static const int poll_group[NIC_WORKER_COUNT] = NIC_POLL_GROUP_TABLE;
+static unsigned short poll_ports[NIC_POLL_COUNT + 1][NIC_WORKER_COUNT];
+
+/*
+ * Instanciate the shared worker pool and the home ports of its workers.
+ */
+static worker_t pool[NIC_POOL_COUNT];
+static const pool_cfg_t pool_cfg[NIC_POOL_COUNT] = NIC_POOL_TABLE;
+static const int pool_home[NIC_WORKER_COUNT] = NIC_POOL_HOME_TABLE;
+static unsigned short pool_ports[NIC_POOL_COUNT][NIC_WORKER_COUNT];
+
 /*
  * Instanciate the traffic generator.
  */
 static traffic_t traffic;
 
+/*
+ * Instanciate the result export.
+ */
+static export_t exporter;
+
+/*
+ * Instanciate the CPU usage sampler.
+ */
+static usage_t usage;
+
 /*
  * Instanciate the network driver.
  */
 static net_t net = {0};
 
-static StaticTask_t obs_handle;
-
 void app_main(void)
 {
     ESP_LOGI(TAG, "app_main reached. Initializing ...");
 
+    /* Align the clocks of the cores before the first stamp is taken. */
+    clock_init();
+
+    /* Calibrate the port workloads while nothing else is running. */
+    workload_init();
+
+    /* Start streaming results before the first packet can finish. */
+    export_init(&exporter);
+
     /* Initialize traffic. */
     traffic_init(&traffic);
 
     /* Initialize the network simulation. */
     net_init(&net);
 
-    /* Initialize worker. */
-    worker_init("WRK-1", &worker[0], 0, 0, 14);
-    worker_init("WRK-2", &worker[1], 1, 1, 13);
-    worker_init("WRK-3", &worker[2], 2, 2, 12);
-    worker_init("WRK-4", &worker[3], 3, 3, 11);
-    // worker_init("WRK-5", &worker[4], 4, 4, 10);
-    //obs_init(15, &obs[0]);
+    /* Initialize worker, placed as the experiment config says. */
+    for (int i = 0; i < NIC_WORKER_COUNT && !NIC_POOL; i++) {
+        if (poll_group[i] >= 0)
+            continue;
+        worker_init(
+            worker_cfg[i].name, &worker[i], i, worker_cfg[i].port,
+            worker_cfg[i].priority, worker_cfg[i].core
+        );
+    }
+
+    /*
+     * Poll workers take the place of the workers of their ports, the first
+     * of them lends its id.
+     */
+    for (int p = 0; p < NIC_POLL_COUNT && !NIC_POOL; p++) {
+        int count = 0;
+        int id = -1;
+
+        for (int i = 0; i < NIC_WORKER_COUNT; i++) {
+            if (poll_group[i] != p)
+                continue;
+            if (id < 0)
+                id = i;
+            poll_ports[p][count++] = worker_cfg[i].port;
+        }
+        worker_init_poll(
+            poll_cfg[p].name, &poll_worker[p], id, poll_ports[p], count,
+            poll_cfg[p].priority, poll_cfg[p].core
+        );
+    }
+
+    /* Or the pool, every worker serving its home ports first. */
+    for (int p = 0; p < NIC_POOL_COUNT && NIC_POOL; p++) {
+        int count = 0;
+
+        for (int i = 0; i < NIC_WORKER_COUNT; i++) {
+            if (pool_home[i] == p)
+                pool_ports[p][count++] = worker_cfg[i].port;
+        }
+        worker_init_pool(
+            pool_cfg[p].name, &pool[p], p, pool_ports[p], count,
+            pool_cfg[p].priority, pool_cfg[p].core
+        );
+    }
+
+    /*
+     * Poll and pool workers serve many ports, their priorities stay fixed
+     * and only the misses of their ports are counted.
+     */
+    for (int i = 0; i < NIC_WORKER_COUNT; i++) {
+        if (NIC_POOL || poll_group[i] >= 0) {
+            deadline_watch(worker_cfg[i].port, worker_cfg[i].deadline_us);
+            continue;
+        }
+        deadline_register(
+            worker[i].task, worker_cfg[i].port, worker_cfg[i].priority,
+            worker_cfg[i].deadline_us
+        );
+    }
+
+    /* Periodic tasks wait for the replay to start. */
+    periodic_init();
+
+    /* Account CPU time once every task exists. */
+    usage_init(&usage);
+
+    /* Report memory use once the workers have bound their sockets. */
+    net_print_mem();
 }
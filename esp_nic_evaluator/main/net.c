@@ -6,11 +6,18 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
-#include "driver/gpio.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_ipc.h"
+#include "clock.h"
+#include "deadline.h"
 
 #include "net.h"
+#include "net_api.h"
+#include "pbuf.h"
 #include "tasks.h"
 #include "traffic.h"
+#include "export.h"
 
 
 static const char* TAG = "NET";
@@ -22,37 +29,173 @@ static const char* TAG = "NET";
 static net_t *net;
 
 /**
- * Configure the NET_PIN that receives the packet signal.
+ * Static storage for all ingress and socket queues. Queues only hold
+ * packet buffer pointers, the arena is sized by nic_config.h.
  */
-static gpio_config_t net_gpio_cfg = {
-    .mode = GPIO_MODE_INPUT,
-    .intr_type = GPIO_PIN_INTR_ANYEDGE,
-    .pin_bit_mask = NET_PIN_MASK,
-    .pull_up_en = 1,
-};
+static trace_packet_t* net_arena[NIC_ARENA_SLOTS];
+
+/**
+ * Drop counters are updated from the ISR and all net tasks.
+ */
+static portMUX_TYPE net_drop_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Protects the waiting state of sockets used for priority boosting.
+ */
+static portMUX_TYPE net_prio_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Protects the per vector ISR accounting, updated by the ISR and read by
+ * the usage sampler, which may run on the other core.
+ */
+static portMUX_TYPE net_vector_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Protects socket allocation, the port table and the queue arena against
+ * workers binding on both cores at once.
+ */
+static portMUX_TYPE net_bind_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Protects the sockets the ISR early demuxed to and left to the net task
+ * to notify with NIC_EDF.
+ */
+static portMUX_TYPE net_early_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Compile-time NIC queue and port layout from nic_config.h.
+ */
+static const net_queue_cfg_t net_queue_cfg[NIC_QUEUE_COUNT] = NIC_QUEUE_TABLE;
+static const net_port_cfg_t net_port_cfg[NIC_PORT_COUNT] = NIC_PORT_TABLE;
+static const coalesce_cfg_t net_coalesce_cfg[NIC_QUEUE_COUNT] =
+                                                        NIC_COALESCE_TABLE;
 
 /**
  * net_main() - net driver er task
  *
- * Acts as the main loop that dequeues an item from the
- * general receive queue on each cycle.
+ * Acts as the main loop that drains up to NET_BATCH_BUDGET items from the
+ * ingress queue of its NIC queue on each wakeup. Every socket that received
+ * data during a batch is notified once at the end of the batch.
  */
-static void net_main(net_t* net);
+static void net_main(net_queue_t* queue);
 
 /**
  * net_process_packet() - Simulates load per packet
  *
- * distributes packet among subscribed tasks.
+ * distributes packet among subscribed tasks. Ownership of the packet
+ * buffer passes to the socket, or back to the pool if it is dropped.
+ * Returns the socket the packet was queued on or 0 if it was dropped.
+ */
+static int net_process_packet(net_t* net, trace_packet_t* packet);
+
+/**
+ * net_isr_install() - install the GPIO ISR on the calling core
+ *
+ * Interrupts are allocated on the core that installs them, so this runs
+ * on NIC_ISR_CORE.
+ */
+static void net_isr_install(void* arg);
+
+/**
+ * net_port_lookup() - find the demux table entry of a port
+ *
+ * Probes until the first free slot. Returns NULL if the port is neither
+ * configured nor bound. Safe to be called from the ISR.
+ */
+static net_port_t* IRAM_ATTR net_port_lookup(unsigned short port);
+
+/**
+ * net_port_insert() - find or claim the demux table entry of a port
+ *
+ * New entries are received on NIC_DEFAULT_QUEUE and unbound. Returns NULL
+ * if the table is full. Must be called with `net_bind_mux` taken once
+ * workers run.
+ */
+static net_port_t* net_port_insert(unsigned short port);
+
+/**
+ * net_arena_alloc() - take storage for a queue from the static arena
+ *
+ * Returns NULL if less than `slots` packet buffer pointers are left.
+ */
+static uint8_t* net_arena_alloc(int slots);
+
+/**
+ * net_drop() - account a dropped packet
+ *
+ * Counts the drop per reason, per socket if `entry` is given, and exports
+ * the result of the packet. Safe to be called from the ISR.
+ */
+static void IRAM_ATTR net_drop(sock_table_t* entry,
+                                const trace_packet_t* packet, int reason);
+
+/**
+ * net_enqueue_from_isr() - put a packet buffer into a queue from the ISR
+ *
+ * `entry` is the socket if `queue` is a socket queue, NULL for an ingress
+ * queue. Applies the socket's overflow policy and accounts drops. Returns
+ * 1 if the packet was queued, 0 if it was dropped.
+ */
+static int IRAM_ATTR net_enqueue_from_isr(QueueHandle_t queue,
+            sock_table_t* entry, trace_packet_t* pbuf, BaseType_t* woke);
+
+/**
+ * net_coalesce_hold() - hold a packet back in a moderated NIC queue
+ *
+ * Flushes all held packets if the packet reaches the packet limit. Returns
+ * the number of packets queued in the ingress queue.
  */
-static void net_process_packet(net_t* net, trace_packet_t* packet);
+static int IRAM_ATTR net_coalesce_hold(net_queue_t* queue,
+            trace_packet_t* pbuf, BaseType_t* woke);
+
+/**
+ * net_coalesce_flush() - move all held packets to the ingress queue
+ *
+ * Must be called with `hold_mux` taken. Returns the number of packets
+ * queued.
+ */
+static int IRAM_ATTR net_coalesce_flush(net_queue_t* queue,
+            BaseType_t* woke);
+
+/**
+ * net_coalesce_arm() - arm the moderation timer for the next deadline
+ */
+static void IRAM_ATTR net_coalesce_arm(net_queue_t* queue);
+
+/**
+ * net_coalesce_timer() - moderation timer callback
+ *
+ * Runs in the esp_timer task.
+ */
+static void net_coalesce_timer(void* arg);
+
+/**
+ * net_prio_update() - match a net task's priority to its waiting workers
+ *
+ * With NIC_PRIO_BOOST the net task of NIC queue `q` is moved one priority
+ * above the highest priority task waiting on a socket received on that
+ * queue, or to NET_PRIO_IDLE if none waits. Does nothing otherwise.
+ *
+ * Called by workers and the net task alike, see the generation check.
+ */
+static void net_prio_update(int q);
+
+/**
+ * net_waiting() - mark a socket's owner as waiting or running
+ *
+ * Boosts the net task serving the socket when the owner starts waiting.
+ * Does nothing without NIC_PRIO_BOOST, so receives take no lock then.
+ */
+static void net_waiting(sock_table_t* entry, int waiting);
 
 /**
  * net_recv_cb() - network data receive callback function
  *
  * This callback function is installed into the sock_table when a user
- * wants to receive data on that particular socket.
+ * wants to receive data on that particular socket. Returns pdTRUE if a
+ * packet was taken from the socket queue.
  */
-static void net_recv_cb(void *dest, int size, QueueHandle_t handle);
+static BaseType_t net_recv_cb(void **dest, QueueHandle_t handle);
 
 
 void
@@ -63,31 +206,92 @@ net_init
     net = net_ptr;
 
     /* Create Shared data objects and init sock table.. */
-    net->packet_queue = xQueueCreate(NET_QUEUE_SIZE, sizeof(trace_packet_t));
+    pbuf_init();
+    for (int q = 0; q < NIC_QUEUE_COUNT; q++) {
+        net->queue[q].packet_queue = xQueueCreateStatic(
+            net_queue_cfg[q].depth,
+            sizeof(trace_packet_t*),
+            net_arena_alloc(net_queue_cfg[q].depth),
+            &net->queue[q].packet_queue_buf
+        );
+        net->queue[q].early_demux = NET_EARLY_DEMUX && net_queue_cfg[q].early_demux;
+        net->queue[q].prio =
+            NIC_PRIO_BOOST ? NET_PRIO_IDLE : net_queue_cfg[q].priority;
+
+        /* Moderate on the device instead of replaying flushes. */
+        if (NIC_COALESCE) {
+            net_queue_t *queue = &net->queue[q];
+            esp_timer_create_args_t timer_args = {
+                .callback = net_coalesce_timer,
+                .arg = queue,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = net_queue_cfg[q].name,
+            };
+
+            coalesce_init(&queue->coalesce, &net_coalesce_cfg[q]);
+            portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+            queue->hold_mux = mux;
+            queue->armed = COALESCE_DISARMED;
+            esp_timer_create(&timer_args, &queue->timer);
+            queue->coalescing = 1;
+        }
+    }
     net->sock_high = 0;
+
+    /* Steer every configured port to the NIC queue it is received on. */
+    for (int i = 0; i < NIC_PORT_COUNT; i++) {
+        net_port_t *port = net_port_insert(net_port_cfg[i].port);
+
+        if (port == NULL) {
+            ets_printf("No port table slot for :%u\n", net_port_cfg[i].port);
+            continue;
+        }
+        port->queue = net_port_cfg[i].queue;
+        port->depth = net_port_cfg[i].depth;
+        port->overflow = net_port_cfg[i].overflow;
+    }
+
+    if (NIC_ISR_CORE == xPortGetCoreID())
+        net_isr_install(NULL);
+    else
+        esp_ipc_call_blocking(NIC_ISR_CORE, net_isr_install, NULL);
+
+    /* Start one net task per NIC queue. */
+    for (int q = 0; q < NIC_QUEUE_COUNT; q++) {
+        net_queue_t *queue = &net->queue[q];
+
+        queue->task = NULL;
+        task_net[q] = &queue->task;
+        queue->task = xTaskCreateStaticPinnedToCore(
+            (TaskFunction_t)net_main,
+            net_queue_cfg[q].name,
+            NET_STACK_SIZE,
+            queue,
+            queue->prio,
+            queue->stack,
+            &queue->tcb,
+            net_queue_cfg[q].core
+        );
+    }
+}
+
+static void
+net_isr_install
+(void* arg)
+{
     ets_printf("ISR registered to core %d\n", xPortGetCoreID());
-    /* Apply config for NET_PIN. */
-    gpio_config(&net_gpio_cfg);
-
-    /* Set IRQ to trigger on rising edge. */
-    gpio_set_intr_type(NET_PIN, GPIO_INTR_ANYEDGE);
-    gpio_install_isr_service(ESP_INTR_FLAG_EDGE);
-
-    /* Pass ISR callback */
-    gpio_isr_handler_add(NET_PIN, net_gpio_isr, (void*)NET_PIN);
-
-    net->task = NULL;
-    task_net = &net->task;
-    net->task = xTaskCreateStaticPinnedToCore(
-        (TaskFunction_t)net_main,
-        NET_TASK_NAME,
-        NET_STACK_SIZE,
-        net,
-        NET_TASK_PRIORITY,
-        net->stack,
-        &net->tcb,
-        NET_CORE
-    );
+
+    /* One line and ISR per vector. */
+    vector_init(net_gpio_isr);
+}
+
+int
+net_vector
+(unsigned short port)
+{
+    net_port_t *entry = net_port_lookup(port);
+
+    return vector_of_queue(entry ? entry->queue : NIC_DEFAULT_QUEUE);
 }
 
 void IRAM_ATTR
@@ -96,26 +300,132 @@ net_gpio_isr
 {
     BaseType_t queue_woke = pdFALSE;
     BaseType_t notify_woke = pdFALSE;
+    uint32_t start = clock_now();
+    int vector = (int)(intptr_t)id;
 
-    if ((int)id == NET_PIN) {
+    if (vector < VECTOR_COUNT) {
 
         /*
          * Simulate packet reception. Batch receive all packages
          * that belong to the same IRQ which are determined by the
          * interrupt moderation trace from which the trace is generated.
+         * All packets of an IRQ belong to the same NIC queue.
          */
+        net_port_t *port = net_port_lookup(shared.port);
+        int port_queue = port ? port->queue : NIC_DEFAULT_QUEUE;
+        int q = vector_queue(vector, 0);
+        int mismatch = 1;
+
+        /*
+         * The vector decides the queue. Of the queues sharing a vector the
+         * one of the port is taken, a port of another vector is counted.
+         */
+        for (int n = 0, v_q; (v_q = vector_queue(vector, n)) >= 0; n++) {
+            if (v_q == port_queue) {
+                q = v_q;
+                mismatch = 0;
+                break;
+            }
+        }
+
+        net_queue_t *queue = &net->queue[q];
+        QueueHandle_t packet_queue = queue->packet_queue;
+        sock_table_t *entry = NULL;
+        unsigned char path = NET_PATH_NORMAL;
+        int queued = 0;
+
+        /* Every packet of the IRQ carries the ISR entry. */
+        shared.isr = start;
+
+        /*
+         * Early demux: pass-through queues skip the net task and put the
+         * packets straight into the socket mailbox of a bound port. A
+         * moderated queue holds packets of many ports, its flushes always
+         * go through the net task.
+         */
+        if (queue->early_demux && !queue->coalescing &&
+                port != NULL && port->sock) {
+            int sock = port->sock;
+
+            if (net->sock_table[sock].in_queue != NULL) {
+                entry = &net->sock_table[sock];
+                packet_queue = entry->in_queue;
+                path = NET_PATH_EARLY;
+            }
+        }
+
         for(int i=0; i<shared.count; i++) {
-            xQueueSendFromISR(
-                net->packet_queue,
-                &shared,
-                &queue_woke
-            );
+            trace_packet_t* pbuf = pbuf_alloc_from_isr();
+
+            /* Out of buffers, the NIC drops the packet. */
+            if (pbuf == NULL) {
+                net_drop(entry, &shared, NET_DROP_NO_PBUF);
+                shared.seq++;
+                continue;
+            }
+
+            *pbuf = shared;
+            pbuf->path = path;
+
+            /* Early demuxed packets leave the ingress path right here. */
+            if (path == NET_PATH_EARLY)
+                pbuf->dequeue = clock_now();
+
+            /* On-device moderation holds the packet back until a flush. */
+            if (queue->coalescing) {
+                queued += net_coalesce_hold(queue, pbuf, &queue_woke);
+            } else {
+                queued += net_enqueue_from_isr(
+                    packet_queue, entry, pbuf, &queue_woke
+                );
+            }
             shared.seq++;
         }
 
+        if (queue->coalescing)
+            net_coalesce_arm(queue);
+
+        /*
+         * Notify the worker once for all early demuxed packets. With
+         * NIC_EDF deadline_update() must run before the worker wakes up,
+         * which cannot be done here, so the net task of the queue does
+         * both. A NULL packet wakes it up, unless a wakeup is pending.
+         */
+        if (NIC_EDF && entry != NULL && queued) {
+            uint32_t early;
+
+            portENTER_CRITICAL_ISR(&net_early_mux);
+            early = queue->early_socks;
+            queue->early_socks |= NET_SOCK_BIT(port->sock);
+            portEXIT_CRITICAL_ISR(&net_early_mux);
+
+            if (!early) {
+                trace_packet_t* wakeup = NULL;
+
+                xQueueSendFromISR(queue->packet_queue, &wakeup, &queue_woke);
+            }
+        } else if (entry != NULL && queued) {
+            xTaskNotifyFromISR(
+                entry->task,
+                NET_SOCK_BIT(port->sock),
+                eSetBits,
+                &notify_woke
+            );
+        }
+
         /* Unblock trace reader. */
         vTaskNotifyGiveFromISR(*task_traffic, &notify_woke);
 
+        /* Handling cost per vector, the ISRs of all vectors are serial. */
+        uint32_t cycles = clock_now() - start;
+        portENTER_CRITICAL_ISR(&net_vector_mux);
+        net->vector_irqs[vector]++;
+        net->vector_mismatch[vector] += mismatch;
+        net->vector_cycles[vector] += cycles;
+        if (cycles > net->vector_max[vector])
+            net->vector_max[vector] = cycles;
+        portEXIT_CRITICAL_ISR(&net_vector_mux);
+
         /* Force reschedule after ISR. */
         portYIELD_FROM_ISR(&notify_woke);
     }
@@ -125,17 +435,26 @@ int
 net_sock
 (void)
 {
+    int sock;
+
+    portENTER_CRITICAL(&net_bind_mux);
+
+    /* Socket table exhausted. */
+    if (net->sock_high + 1 >= NET_SOCK_MAX) {
+        portEXIT_CRITICAL(&net_bind_mux);
+        return -1;
+    }
+
     /* Increment sock mark. */
-    net->sock_high++;
+    sock = ++net->sock_high;
 
     /* Associate sock with task. */
-    sock_table_t *entry = &net->sock_table[net->sock_high];
+    sock_table_t *entry = &net->sock_table[sock];
     entry->task = xTaskGetCurrentTaskHandle();
-    entry->in_queue = xQueueCreate(NET_QUEUE_SIZE, sizeof(trace_packet_t));
-    if (entry->in_queue == NULL)
-        ESP_LOGD(TAG, "Queue creation failed.");
+    entry->in_queue = NULL;
+    portEXIT_CRITICAL(&net_bind_mux);
 
-    return net->sock_high;
+    return sock;
 }
 
 
@@ -143,19 +462,72 @@ int
 net_bind
 (int sock, unsigned short port)
 {
-    sock_table_t *entry = &net->sock_table[sock];
+    sock_table_t *entry;
+    net_port_t *slot;
+    uint8_t *storage = NULL;
+
+    if (sock <= 0 || sock >= NET_SOCK_MAX)
+        return -1;
+    entry = &net->sock_table[sock];
 
     /* Unassociated sock or taken by another task. */
     if (entry->task == NULL || entry->task != xTaskGetCurrentTaskHandle())
         return -1;
 
-    /* Port out of range. */
-    if (port > NET_PORT_MAX)
-        return -2;
+    /*
+     * Workers on both cores bind at the same time. Claim the port and the
+     * queue storage under the lock, the queue is created outside of it.
+     */
+    portENTER_CRITICAL(&net_bind_mux);
+    slot = net_port_insert(port);
+    if (slot == NULL || (slot->owner && slot->owner != sock)) {
+        portEXIT_CRITICAL(&net_bind_mux);
+        return slot == NULL ? -2 : -4;
+    }
+
+    /* Socket queues are sized by the port, a new port may need another. */
+    if (entry->in_queue == NULL || entry->depth != slot->depth) {
+        storage = net_arena_alloc(slot->depth);
+        if (storage == NULL) {
+            portEXIT_CRITICAL(&net_bind_mux);
+            ESP_LOGD(TAG, "Queue arena exhausted.");
+            return -3;
+        }
+    }
+    slot->owner = sock;
+
+    /* Rebinding releases the previous port. */
+    if (entry->in_queue != NULL && entry->port != port) {
+        net_port_t *old = net_port_lookup(entry->port);
+
+        if (old != NULL && old->owner == sock) {
+            old->owner = 0;
+            old->sock = 0;
+        }
+    }
+    portEXIT_CRITICAL(&net_bind_mux);
+
+    /* No port delivers to the socket while its queue is replaced. */
+    if (storage != NULL) {
+        trace_packet_t *pbuf;
+
+        while (entry->in_queue != NULL &&
+                xQueueReceive(entry->in_queue, &pbuf, 0) == pdTRUE)
+            pbuf_free(pbuf);
+        entry->in_queue = xQueueCreateStatic(
+            slot->depth,
+            sizeof(trace_packet_t*),
+            storage,
+            &entry->in_queue_buf
+        );
+        entry->depth = slot->depth;
+    }
 
-    /* Associate sock with port and populate port map. */
+    /* Associate sock with port, then let the driver deliver to it. */
     entry->port = port;
-    net->port_map[port] = sock;
+    entry->overflow = slot->overflow;
+    entry->queue = slot->queue;
+    slot->sock = sock;
 
     return 0;
 }
@@ -163,7 +535,7 @@ net_bind
 
 int
 net_recv
-(int sock, void* dest, int size)
+(int sock, void** buf)
 {
     /*
      * NOTE:
@@ -173,97 +545,713 @@ net_recv
      * time data arrives) and result in data loss.
      */
 
-    sock_table_t *entry = &net->sock_table[sock];
+    sock_table_t *entry;
 
-    /* Unassociated sock or taken by another task. */
-    if (entry->task == NULL || entry->task != xTaskGetCurrentTaskHandle())
+    if (sock <= 0 || sock >= NET_SOCK_MAX)
+        return -1;
+    entry = &net->sock_table[sock];
+
+    /* Unassociated, unbound sock or taken by another task. */
+    if (entry->task == NULL || entry->task != xTaskGetCurrentTaskHandle() ||
+            entry->in_queue == NULL)
         return -1;
 
     /* Install callback. */
     entry->recv_cb = net_recv_cb;
-    entry->dest_cb = dest;
+    entry->dest_cb = buf;
 
-    /* Only allow NET_BUF_SIZE amount of bytes to be copied. */
-    if (0 < size && size < NET_BUF_SIZE) {
-        entry->size_cb = size;
-    } else {
+    /*
+     * Execute receive callback. The driver notifies once per batch, so
+     * only wait for the driver to aquire data on that port once the
+     * socket queue has been drained.
+     */
+    while (entry->recv_cb(entry->dest_cb, entry->in_queue) != pdTRUE) {
+        net_waiting(entry, 1);
+        xTaskNotifyWait(0, NET_SOCK_BIT(sock), NULL, portMAX_DELAY);
+        net_waiting(entry, 0);
+    }
+
+    return sizeof(trace_packet_t);
+}
+
+int
+net_recvmmsg
+(int sock, void** bufs, int count, TickType_t timeout)
+{
+    sock_table_t *entry;
+    TickType_t start = xTaskGetTickCount();
+
+    if (sock <= 0 || sock >= NET_SOCK_MAX)
+        return -1;
+    entry = &net->sock_table[sock];
+
+    /* Unassociated, unbound sock or taken by another task. */
+    if (entry->task == NULL || entry->task != xTaskGetCurrentTaskHandle() ||
+            entry->in_queue == NULL)
+        return -1;
+
+    if (count <= 0)
         return -2;
+
+    /* Wait until the first packet arrived or the timeout expired. */
+    while (xQueueReceive(entry->in_queue, &bufs[0], 0) != pdTRUE) {
+        TickType_t wait = portMAX_DELAY;
+
+        if (timeout != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout)
+                return 0;
+            wait = timeout - elapsed;
+        }
+        net_waiting(entry, 1);
+        xTaskNotifyWait(0, NET_SOCK_BIT(sock), NULL, wait);
+        net_waiting(entry, 0);
+    }
+
+    /* Take whatever else is queued without blocking again. */
+    int received = 1;
+    while (received < count &&
+            xQueueReceive(entry->in_queue, &bufs[received], 0) == pdTRUE) {
+        received++;
+    }
+
+    return received;
+}
+
+int
+net_poll
+(net_pollfd_t* fds, int nfds, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    uint32_t interest = NET_POLL_KICK;
+    uint32_t bits = 0;
+
+    /* Collect the notification bits of all sockets of interest. */
+    for (int i = 0; i < nfds; i++) {
+        int sock = fds[i].sock;
+
+        /* Unassociated, unbound sock or taken by another task. */
+        if (sock <= 0 || sock >= NET_SOCK_MAX ||
+                net->sock_table[sock].task != xTaskGetCurrentTaskHandle() ||
+                net->sock_table[sock].in_queue == NULL)
+            return -1;
+
+        interest |= NET_SOCK_BIT(sock);
     }
 
-    /* Wait for the driver to aquire data on that port. */
-    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    while (1) {
+        int ready = 0;
 
-    /* Execute receive callback. */
-    entry->recv_cb(entry->dest_cb, entry->size_cb, entry->in_queue);
+        /* The socket queues tell what is ready, bits only wake us up. */
+        for (int i = 0; i < nfds; i++) {
+            sock_table_t *entry = &net->sock_table[fds[i].sock];
 
-    return size;
+            fds[i].revents = 0;
+            if (uxQueueMessagesWaiting(entry->in_queue)) {
+                fds[i].revents = NET_POLLIN;
+                ready++;
+            }
+        }
+
+        if (ready)
+            return ready;
+        if (bits & NET_POLL_KICK)
+            return 0;
+
+        TickType_t wait = portMAX_DELAY;
+        if (timeout != portMAX_DELAY) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= timeout)
+                return 0;
+            wait = timeout - elapsed;
+        }
+        for (int i = 0; i < nfds; i++) {
+            net_waiting(&net->sock_table[fds[i].sock], 1);
+        }
+        xTaskNotifyWait(0, interest, &bits, wait);
+        for (int i = 0; i < nfds; i++) {
+            net_waiting(&net->sock_table[fds[i].sock], 0);
+        }
+    }
+}
+
+void
+net_poll_kick
+(TaskHandle_t task)
+{
+    xTaskNotify(task, NET_POLL_KICK, eSetBits);
+}
+
+int
+net_backlog
+(int sock)
+{
+    if (sock <= 0 || sock >= NET_SOCK_MAX ||
+            net->sock_table[sock].in_queue == NULL)
+        return -1;
+
+    return uxQueueMessagesWaiting(net->sock_table[sock].in_queue);
+}
+
+int
+net_steal
+(int sock, void** bufs, int count)
+{
+    int received = 0;
+
+    if (sock <= 0 || sock >= NET_SOCK_MAX ||
+            net->sock_table[sock].in_queue == NULL)
+        return -1;
+
+    while (received < count && xQueueReceive(
+            net->sock_table[sock].in_queue, &bufs[received], 0) == pdTRUE) {
+        received++;
+    }
+
+    return received;
+}
+
+void
+net_free
+(void* buf)
+{
+    pbuf_free((trace_packet_t*)buf);
 }
 
 static void
 net_main
-(net_t* net)
+(net_queue_t* queue)
 {
     ets_printf("NET registered to core %d\n", xPortGetCoreID());
     while (1) {
-        trace_packet_t packet;
+        trace_packet_t* packet;
+        int ready[NET_SOCK_MAX];
+        int ready_count = 0;
+        int batch = 0;
 
         /* Receive packet from trace or block. */
-        BaseType_t status = xQueueReceive(
-            net->packet_queue,
-            &packet,
-            (TickType_t)portMAX_DELAY
-        );
+        TickType_t wait = portMAX_DELAY;
+
+        /* Drain the queue without blocking until the budget is spent. */
+        while (batch < NET_BATCH_BUDGET &&
+                xQueueReceive(queue->packet_queue, &packet, wait) == pdTRUE) {
+            wait = 0;
+
+            /* Wakeup by the ISR for early demuxed packets, see below. */
+            if (packet == NULL)
+                continue;
+            batch++;
+
+            /* Process package and remember its socket once per batch. */
+            int sock = net_process_packet(net, packet);
+            if (sock && !net->sock_table[sock].batch_mark) {
+                net->sock_table[sock].batch_mark = 1;
+                ready[ready_count++] = sock;
+            }
+        }
+
+        /* Sockets the ISR early demuxed to with NIC_EDF. */
+        if (NIC_EDF) {
+            uint32_t early;
+
+            portENTER_CRITICAL(&net_early_mux);
+            early = queue->early_socks;
+            queue->early_socks = 0;
+            portEXIT_CRITICAL(&net_early_mux);
+
+            for (int sock = 1; early; sock++) {
+                if (!(early & NET_SOCK_BIT(sock)))
+                    continue;
+                early &= ~NET_SOCK_BIT(sock);
+                if (!net->sock_table[sock].batch_mark) {
+                    net->sock_table[sock].batch_mark = 1;
+                    ready[ready_count++] = sock;
+                }
+            }
+        }
 
-        /* Process package. */
-        if (status == pdTRUE) {
-            net_process_packet(net, &packet);
+        /* Reprioritize by deadline before the workers wake up. */
+        if (ready_count)
+            deadline_update();
+
+        /* Notify each associated task once for the whole batch. */
+        for (int i = 0; i < ready_count; i++) {
+            net->sock_table[ready[i]].batch_mark = 0;
+            xTaskNotify(
+                net->sock_table[ready[i]].task,
+                NET_SOCK_BIT(ready[i]),
+                eSetBits
+            );
+        }
+
+        if (batch) {
+            queue->batch_hist[batch]++;
+            queue->batch_count++;
+            queue->batch_packets += batch;
         }
+
+        /* Drop back once the waiting workers have been served. */
+        net_prio_update(queue - net->queue);
     }
 }
 
-static void
+static int
 net_process_packet
 (net_t* net, trace_packet_t* packet)
 {
+    packet->dequeue = clock_now();
+
     ESP_LOGD(
         TAG, "PP seq=%d, delta=%hu, port=%u",
         packet->seq, packet->delta, packet->port
     );
 
     /* Find process to notify about ingress data. */
-    int sock = net->port_map[packet->port];
+    net_port_t *port = net_port_lookup(packet->port);
+    int sock = port ? port->sock : 0;
+    uint32_t sent = packet->sent;
 
     if (0 < sock && sock < NET_SOCK_MAX) {
+        sock_table_t *entry = &net->sock_table[sock];
+
         /* Put the packet into the socket mailbox. */
-        if(xQueueSend(net->sock_table[sock].in_queue, packet, 0) == pdPASS) {
-            /* Notify the associated task. */
-            xTaskNotifyGive(net->sock_table[sock].task);
-        } else {
-            ESP_LOGD(TAG, "Queue full for that socket.");
+        if(xQueueSend(entry->in_queue, &packet, 0) == pdPASS) {
+            /* The associated task is notified at the end of the batch. */
+            deadline_arrive(port->port, sent);
+            return sock;
+        }
+
+        ESP_LOGD(TAG, "Queue full for that socket.");
+
+        /* Evict the oldest packet to make room if the policy says so. */
+        if (entry->overflow == NET_OVERFLOW_DROP_OLDEST) {
+            trace_packet_t* oldest;
+
+            if (xQueueReceive(entry->in_queue, &oldest, 0) == pdTRUE) {
+                net_drop(entry, oldest, NET_DROP_EVICTED);
+                pbuf_free(oldest);
+            }
+            if(xQueueSend(entry->in_queue, &packet, 0) == pdPASS) {
+                deadline_arrive(port->port, sent);
+                return sock;
+            }
         }
+
+        net_drop(entry, packet, NET_DROP_SOCK_FULL);
+        pbuf_free(packet);
     } else {
         ESP_LOGD(TAG, "No sock registered for that port (:%d).", packet->port);
+        net_drop(NULL, packet, NET_DROP_NO_SOCK);
+        pbuf_free(packet);
+    }
+
+    return 0;
+}
+
+/*
+ * Fibonacci hashing of the port onto the upper NET_PORT_BITS bits.
+ */
+static inline unsigned int
+net_port_hash
+(unsigned short port)
+{
+    return ((port * 40503u) & 0xffff) >> (16 - NET_PORT_BITS);
+}
+
+static net_port_t* IRAM_ATTR
+net_port_lookup
+(unsigned short port)
+{
+    unsigned int slot = net_port_hash(port);
+
+    for (int i = 0; i < NET_PORT_SLOTS; i++) {
+        net_port_t *entry = &net->port_table[(slot + i) & (NET_PORT_SLOTS - 1)];
+
+        if (!entry->used)
+            return NULL;
+        if (entry->port == port)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static net_port_t*
+net_port_insert
+(unsigned short port)
+{
+    unsigned int slot = net_port_hash(port);
+
+    for (int i = 0; i < NET_PORT_SLOTS; i++) {
+        net_port_t *entry = &net->port_table[(slot + i) & (NET_PORT_SLOTS - 1)];
+
+        if (entry->used && entry->port == port)
+            return entry;
+
+        if (!entry->used) {
+            entry->port = port;
+            entry->queue = NIC_DEFAULT_QUEUE;
+            entry->sock = 0;
+            entry->owner = 0;
+            entry->depth = NIC_SOCK_DEPTH;
+            entry->overflow = NIC_SOCK_OVERFLOW;
+            entry->used = 1;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void IRAM_ATTR
+net_drop
+(sock_table_t* entry, const trace_packet_t* packet, int reason)
+{
+    result_t result = {
+        .seq = packet->seq,
+        .port = packet->port,
+        .sent = packet->sent,
+        .isr = packet->isr,
+        .dequeue = packet->dequeue,
+        .drop = reason,
+    };
+
+    portENTER_CRITICAL_SAFE(&net_drop_mux);
+    net->drops[reason]++;
+    if (entry != NULL)
+        entry->drops[reason]++;
+    portEXIT_CRITICAL_SAFE(&net_drop_mux);
+
+    export_push(&result);
+}
+
+static int IRAM_ATTR
+net_enqueue_from_isr
+(QueueHandle_t queue, sock_table_t* entry, trace_packet_t* pbuf,
+                                                        BaseType_t* woke)
+{
+    /* The buffer may be gone once it is queued. */
+    unsigned short port = pbuf->port;
+    uint32_t sent = pbuf->sent;
+    BaseType_t status = xQueueSendFromISR(queue, &pbuf, woke);
+
+    /* A full socket queue may evict its oldest packet instead. */
+    if (status != pdPASS && entry != NULL &&
+            entry->overflow == NET_OVERFLOW_DROP_OLDEST) {
+        trace_packet_t* oldest;
+
+        if (xQueueReceiveFromISR(queue, &oldest, woke)) {
+            net_drop(entry, oldest, NET_DROP_EVICTED);
+            pbuf_free_from_isr(oldest);
+        }
+        status = xQueueSendFromISR(queue, &pbuf, woke);
+    }
+
+    if (status != pdPASS) {
+        net_drop(
+            entry, pbuf,
+            entry ? NET_DROP_SOCK_FULL : NET_DROP_INGRESS
+        );
+        pbuf_free_from_isr(pbuf);
+        return 0;
+    }
+
+    if (entry != NULL)
+        deadline_arrive(port, sent);
+
+    return 1;
+}
+
+static int IRAM_ATTR
+net_coalesce_hold
+(net_queue_t* queue, trace_packet_t* pbuf, BaseType_t* woke)
+{
+    int queued = 0;
+
+    portENTER_CRITICAL_SAFE(&queue->hold_mux);
+    if (coalesce_full(&queue->coalesce) ||
+            queue->hold_count >= NET_COALESCE_RING) {
+        /* The NIC buffer is full. */
+        net_drop(NULL, pbuf, NET_DROP_INGRESS);
+        pbuf_free_from_isr(pbuf);
+    } else {
+        queue->hold[queue->hold_count++] = pbuf;
+
+        uint64_t now = esp_timer_get_time();
+        if (coalesce_arrival(&queue->coalesce, now) != COALESCE_NONE)
+            queued = net_coalesce_flush(queue, woke);
+    }
+    portEXIT_CRITICAL_SAFE(&queue->hold_mux);
+
+    return queued;
+}
+
+static int IRAM_ATTR
+net_coalesce_flush
+(net_queue_t* queue, BaseType_t* woke)
+{
+    int queued = 0;
+
+    for (int i = 0; i < queue->hold_count; i++) {
+        queued += net_enqueue_from_isr(
+            queue->packet_queue, NULL, queue->hold[i], woke
+        );
     }
+    queue->hold_count = 0;
+
+    return queued;
+}
+
+static void IRAM_ATTR
+net_coalesce_arm
+(net_queue_t* queue)
+{
+    uint64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&queue->hold_mux);
+    uint64_t deadline = coalesce_next_deadline(&queue->coalesce);
+    int rearm = deadline != queue->armed;
+    queue->armed = deadline;
+    portEXIT_CRITICAL_SAFE(&queue->hold_mux);
+
+    if (!rearm)
+        return;
+
+    esp_timer_stop(queue->timer);
+    if (deadline != COALESCE_DISARMED)
+        esp_timer_start_once(queue->timer, deadline > now ? deadline - now : 1);
 }
 
 static void
-net_recv_cb
-(void *dest, int size, QueueHandle_t queue)
+net_coalesce_timer
+(void* arg)
+{
+    net_queue_t *queue = (net_queue_t*)arg;
+    BaseType_t woke = pdFALSE;
+    uint64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&queue->hold_mux);
+    queue->armed = COALESCE_DISARMED;
+    if (coalesce_expire(&queue->coalesce, now) != COALESCE_NONE)
+        net_coalesce_flush(queue, &woke);
+    portEXIT_CRITICAL(&queue->hold_mux);
+
+    net_coalesce_arm(queue);
+
+    /* The callback runs in the esp_timer task, not in an ISR. */
+    if (woke)
+        portYIELD();
+}
+
+void
+net_coalesce_start
+(void)
+{
+    uint64_t now = esp_timer_get_time();
+
+    for (int q = 0; q < NIC_QUEUE_COUNT; q++) {
+        net_queue_t *queue = &net->queue[q];
+
+        if (!queue->coalescing)
+            continue;
+
+        portENTER_CRITICAL(&queue->hold_mux);
+        coalesce_start(&queue->coalesce, now);
+        portEXIT_CRITICAL(&queue->hold_mux);
+
+        net_coalesce_arm(queue);
+    }
+}
+
+static void
+net_prio_update
+(int q)
+{
+    if (!NIC_PRIO_BOOST)
+        return;
+
+    net_queue_t *queue = &net->queue[q];
+    unsigned int gen;
+    int raced;
+
+    /*
+     * Workers and the net task update concurrently and the priority is set
+     * outside the lock. An update whose scan went stale while it set the
+     * priority sees a new generation and runs again, so the priority of
+     * the last waiting state is the one that sticks.
+     */
+    do {
+        UBaseType_t prio = NET_PRIO_IDLE;
+
+        /* Find the highest priority task waiting on this NIC queue. */
+        portENTER_CRITICAL(&net_prio_mux);
+        gen = queue->prio_gen;
+        for (int s = 1; s <= net->sock_high; s++) {
+            sock_table_t *entry = &net->sock_table[s];
+
+            if (entry->waiting && entry->queue == q && entry->prio + 1 > prio)
+                prio = entry->prio + 1;
+        }
+        portEXIT_CRITICAL(&net_prio_mux);
+
+        /* Stay below the traffic generator. */
+        if (prio > configMAX_PRIORITIES - 2)
+            prio = configMAX_PRIORITIES - 2;
+
+        if (uxTaskPriorityGet(queue->task) != prio)
+            vTaskPrioritySet(queue->task, prio);
+
+        portENTER_CRITICAL(&net_prio_mux);
+        raced = queue->prio_gen != gen;
+        if (!raced && queue->prio != prio) {
+            queue->prio = prio;
+            queue->prio_changes++;
+        }
+        portEXIT_CRITICAL(&net_prio_mux);
+    } while (raced);
+}
+
+static void
+net_waiting
+(sock_table_t* entry, int waiting)
+{
+    if (!NIC_PRIO_BOOST)
+        return;
+
+    portENTER_CRITICAL(&net_prio_mux);
+    entry->waiting = waiting;
+    if (waiting)
+        entry->prio = uxTaskPriorityGet(NULL);
+    net->queue[entry->queue].prio_gen++;
+    portEXIT_CRITICAL(&net_prio_mux);
+
+    /* Lowering is left to the net task once it is done with the batch. */
+    if (waiting)
+        net_prio_update(entry->queue);
+}
+
+static uint8_t*
+net_arena_alloc
+(int slots)
 {
-    /* Receive packet. */
-    xQueueReceive(queue, dest, 0);
+    if (net->arena_used + slots > NIC_ARENA_SLOTS)
+        return NULL;
+
+    uint8_t *storage = (uint8_t*)&net_arena[net->arena_used];
+    net->arena_used += slots;
 
+    return storage;
+}
+
+static BaseType_t
+net_recv_cb
+(void **dest, QueueHandle_t queue)
+{
     /*
-     * Note:
-     * In reality src would be taken from the network device.
-     * Some smaller embedded chips do not offer RXDMA queues.
+     * Receive the packet buffer pointer. The payload stays where the ISR
+     * wrote it, just like a RXDMA descriptor pointing into a ring.
      */
+    return xQueueReceive(queue, dest, 0);
+}
 
-    char *ptr = (char*)dest;
-    ptr += sizeof(trace_packet_t);
-    size -= sizeof(trace_packet_t);
+unsigned long long
+net_isr_cycles
+(void)
+{
+    unsigned long long cycles = 0;
 
-    for (int i=0; i<size; i++) {
-        *ptr++ = '\0';
+    portENTER_CRITICAL(&net_vector_mux);
+    for (int v = 0; v < VECTOR_COUNT; v++)
+        cycles += net->vector_cycles[v];
+    portEXIT_CRITICAL(&net_vector_mux);
+
+    return cycles;
+}
+
+void
+net_print_stats
+(void)
+{
+    ets_printf(
+        "# net budget=%d pbuf_exhausted=%u arena_slots=%d/%d\n",
+        NET_BATCH_BUDGET, pbuf_exhausted(), net->arena_used, NIC_ARENA_SLOTS
+    );
+    for (int v = 0; v < VECTOR_COUNT; v++) {
+        if (!net->vector_irqs[v])
+            continue;
+        ets_printf(
+            "# vector=%d pin=%d irqs=%u mean_cycles=%u max_cycles=%u "
+            "mismatch=%u\n",
+            v, vector_pin(v), net->vector_irqs[v],
+            (unsigned int)(net->vector_cycles[v] / net->vector_irqs[v]),
+            net->vector_max[v], net->vector_mismatch[v]
+        );
+    }
+    static const char* drop_names[NET_DROP_COUNT] = {
+        "none", "no_pbuf", "ingress", "no_sock", "sock_full", "evicted"
+    };
+
+    for (int r = NET_DROP_NONE + 1; r < NET_DROP_COUNT; r++) {
+        ets_printf("# drop reason=%s count=%u\n", drop_names[r], net->drops[r]);
+    }
+    for (int s = 1; s <= net->sock_high; s++) {
+        sock_table_t *entry = &net->sock_table[s];
+
+        for (int r = NET_DROP_NONE + 1; r < NET_DROP_COUNT; r++) {
+            if (entry->drops[r]) {
+                ets_printf(
+                    "# drop port=%u reason=%s count=%u\n",
+                    entry->port, drop_names[r], entry->drops[r]
+                );
+            }
+        }
+    }
+
+    for (int q = 0; q < NIC_QUEUE_COUNT; q++) {
+        net_queue_t *queue = &net->queue[q];
+
+        ets_printf(
+            "# net queue=%s core=%d batches=%u packets=%u prio_changes=%u\n",
+            net_queue_cfg[q].name, net_queue_cfg[q].core, queue->batch_count,
+            queue->batch_packets, queue->prio_changes
+        );
+        if (queue->coalescing) {
+            ets_printf(
+                "# coalesce queue=%s packet_limit=%u packet_timer=%u "
+                "absolute_timer=%u\n",
+                net_queue_cfg[q].name,
+                queue->coalesce.flushes[COALESCE_PACKET_LIMIT],
+                queue->coalesce.flushes[COALESCE_PACKET_TIMER],
+                queue->coalesce.flushes[COALESCE_ABSOLUTE_TIMER]
+            );
+        }
+        for (int i = 1; i <= NET_BATCH_BUDGET; i++) {
+            if (queue->batch_hist[i]) {
+                ets_printf(
+                    "# net queue=%s batch_size=%d count=%u\n",
+                    net_queue_cfg[q].name, i, queue->batch_hist[i]
+                );
+            }
+        }
     }
 }
+
+void
+net_print_mem
+(void)
+{
+    ets_printf(
+        "# mem heap_free=%u heap_min_free=%u internal_free=%u largest_block=%u\n",
+        esp_get_free_heap_size(),
+        esp_get_minimum_free_heap_size(),
+        heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT),
+        heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+    );
+    ets_printf(
+        "# mem net=%u queue_arena=%u/%u pbuf_pool=%u\n",
+        sizeof(net_t),
+        net->arena_used * sizeof(trace_packet_t*),
+        sizeof(net_arena),
+        PBUF_COUNT * sizeof(trace_packet_t)
+    );
+}
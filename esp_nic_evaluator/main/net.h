@@ -4,21 +4,53 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
 
 #include "traffic.h"
+#include "coalesce.h"
+#include "net_api.h"
+#include "nic_config.h"
+#include "vector.h"
 
 
-#define NET_CORE            0
 #define NET_STACK_SIZE      0x1000
-#define NET_QUEUE_SIZE      0x400
-#define NET_TASK_NAME       "net"
-#define NET_TASK_PRIORITY   17
-#define NET_PIN             GPIO_NUM_4
-#define NET_PIN_MASK        (1ULL << NET_PIN)
 
-#define NET_SOCK_MAX        255
-#define NET_PORT_MAX        255
-#define NET_BUF_SIZE        65535
+#define NET_SOCK_MAX        32
+
+/*
+ * Port demux table, sized by config2header to at least twice the ports
+ * that can be bound, so probe sequences stay short.
+ */
+#define NET_PORT_BITS       NIC_PORT_BITS
+#define NET_PORT_SLOTS      (1 << NET_PORT_BITS)
+
+/*
+ * Each socket owns one bit of its task's notification value, which is
+ * why there can be at most 32 sockets.
+ */
+#define NET_SOCK_BIT(sock)  (1UL << (sock))
+
+/*
+ * Socket 0 is never handed out, its bit is left for net_poll_kick().
+ */
+#define NET_POLL_KICK       NET_SOCK_BIT(0)
+
+#define NET_BATCH_BUDGET    32
+#define NET_EARLY_DEMUX     1
+
+/*
+ * With NIC_PRIO_BOOST the net task of a NIC queue runs one priority above
+ * the highest priority worker waiting on one of its ports and drops to
+ * NET_PRIO_IDLE while no worker waits. The queue table priorities are
+ * used otherwise.
+ */
+#define NET_PRIO_IDLE       5
+
+/*
+ * Packets a NIC queue holds back with on-device moderation (NIC_COALESCE),
+ * at most. The capacity of a buffer in config.json may be smaller.
+ */
+#define NET_COALESCE_RING   0x80
 
 
 /**
@@ -26,42 +58,172 @@
  *
  * @port    network port associated with socket
  * @task    reference to FreeRTOS task handle
+ * @in_queue    queue of packet buffer pointers, created on bind
+ * @depth   number of packets `in_queue` holds
+ * @in_queue_buf    static control block of `in_queue`
  * @recv_cb receive callback
+ * @dest_cb where the callback stores the received packet buffer pointer
+ * @batch_mark  set while the socket awaits its notification for a batch
+ * @overflow    socket queue overflow policy (NET_OVERFLOW_*)
+ * @drops       dropped packets of this socket per reason (NET_DROP_*)
+ * @queue       NIC queue the bound port is received on
+ * @waiting     the owning task is blocked waiting for this socket
+ * @prio        priority of the owning task when it started waiting
  */
 typedef struct {
     unsigned short port;
     TaskHandle_t task;
     QueueHandle_t in_queue;
-    void (*recv_cb)(void*, int, TaskHandle_t);
-    void* dest_cb;
-    int size_cb;
+    int depth;
+    StaticQueue_t in_queue_buf;
+    BaseType_t (*recv_cb)(void**, QueueHandle_t);
+    void** dest_cb;
+    int batch_mark;
+    int overflow;
+    unsigned int drops[NET_DROP_COUNT];
+    int queue;
+    int waiting;
+    UBaseType_t prio;
 } sock_table_t;
 
 /**
- * Network driver task struct
+ * Port demux table entry.
+ *
+ * @port    network port, the full 16 bit range is supported
+ * @used    slot holds a port
+ * @queue   index of the NIC queue the port is received on
+ * @sock    socket the driver delivers the port's packets to, 0 if unbound
+ * @owner   socket the port is claimed by, set before `sock` while the
+ *          socket queue is created
+ * @overflow    socket queue overflow policy (NET_OVERFLOW_*)
+ * @depth   socket queue depth for the port
+ *
+ * The table is open addressed with linear probing and has twice the
+ * slots of the listed ports of NIC_PORT_TABLE and the ports the spare
+ * sockets can bind, so a lookup ends after a few probes.
+ */
+typedef struct {
+    unsigned short port;
+    unsigned char used;
+    unsigned char queue;
+    unsigned char sock;
+    unsigned char owner;
+    unsigned char overflow;
+    unsigned short depth;
+} net_port_t;
+
+/**
+ * NIC queue configuration, one entry of NIC_QUEUE_TABLE.
+ *
+ * @name        name of the net task serving the queue
+ * @priority    priority of the net task serving the queue
+ * @depth       number of packets the ingress queue holds
+ * @early_demux deliver to the socket from the ISR, bypassing the net task
+ * @core        core the net task is pinned to
+ */
+typedef struct {
+    const char* name;
+    int priority;
+    int depth;
+    int early_demux;
+    int core;
+} net_queue_cfg_t;
+
+/**
+ * Port to NIC queue assignment, one entry of NIC_PORT_TABLE.
+ *
+ * @port        network port
+ * @queue       index of the NIC queue the port is received on
+ * @depth       number of packets the socket queue bound to the port holds
+ * @overflow    what to drop if the socket queue is full (NET_OVERFLOW_*)
+ */
+typedef struct {
+    unsigned short port;
+    int queue;
+    int depth;
+    int overflow;
+} net_port_cfg_t;
+
+/**
+ * Network driver queue struct, one per NIC queue
  *
  * @packet_queue    ingress packet queue
+ * @packet_queue_buf    static control block of `packet_queue`
  * @task            FreeRTOS task handle
  * @tcb             FreeRTOS task tcb
  * @stack           stack area used by the task
- * @sock_table      socket to port and task mapping
- * @port_map        port to socket mapping
- * @sock_high       highest socket
- * @proto_data      source for packet data
+ * @batch_hist      histogram of packets handled per net_main wakeup
+ * @batch_count     number of batches processed
+ * @batch_packets   number of packets processed in all batches
+ * @early_demux     copy of the queue's early demux setting for the ISR
+ * @early_socks     sockets early demuxed to whose owners the net task
+ *                  notifies after deadline_update(), with NIC_EDF
+ * @prio            current priority of the net task
+ * @prio_changes    number of priority changes with NIC_PRIO_BOOST
+ * @prio_gen        bumped whenever a worker of the queue starts or stops
+ *                  waiting, tells a priority update it raced with one
+ * @coalescing      the queue is moderated on the device (NIC_COALESCE)
+ * @coalesce        moderation state of the queue
+ * @hold            packets held back until the next flush
+ * @hold_count      number of packets in `hold`
+ * @hold_mux        protects the moderation state and `hold`
+ * @timer           one-shot timer running the moderation timers
+ * @armed           deadline `timer` is armed for
  */
 typedef struct {
     QueueHandle_t packet_queue;
+    StaticQueue_t packet_queue_buf;
     TaskHandle_t task;
     StaticTask_t tcb;
     StackType_t stack[NET_STACK_SIZE];
+    unsigned int batch_hist[NET_BATCH_BUDGET + 1];
+    unsigned int batch_count;
+    unsigned int batch_packets;
+    int early_demux;
+    uint32_t early_socks;
+    UBaseType_t prio;
+    unsigned int prio_changes;
+    unsigned int prio_gen;
+    int coalescing;
+    coalesce_t coalesce;
+    trace_packet_t* hold[NET_COALESCE_RING];
+    int hold_count;
+    portMUX_TYPE hold_mux;
+    esp_timer_handle_t timer;
+    uint64_t armed;
+} net_queue_t;
+
+/**
+ * Network driver struct
+ *
+ * @queue           NIC queues and the net tasks serving them
+ * @sock_table      socket to port and task mapping
+ * @port_table      port to NIC queue and socket mapping
+ * @sock_high       highest socket
+ * @arena_used      packet buffer pointer slots taken from the queue arena
+ * @drops           dropped packets per reason (NET_DROP_*)
+ * @vector_irqs     interrupts handled per vector
+ * @vector_cycles   CPU cycles spent in the ISR per vector
+ * @vector_max      longest ISR run per vector in CPU cycles
+ * @vector_mismatch IRQs per vector whose port is on a queue of another
+ *                  vector, received on the first queue of the vector
+ */
+typedef struct {
+    net_queue_t queue[NIC_QUEUE_COUNT];
     sock_table_t sock_table[NET_SOCK_MAX];
-    int port_map[NET_PORT_MAX];
+    net_port_t port_table[NET_PORT_SLOTS];
     int sock_high;
+    int arena_used;
+    unsigned int drops[NET_DROP_COUNT];
+    unsigned int vector_irqs[VECTOR_MAX];
+    unsigned long long vector_cycles[VECTOR_MAX];
+    unsigned int vector_max[VECTOR_MAX];
+    unsigned int vector_mismatch[VECTOR_MAX];
 } net_t;
 
 
 /**
- * net_init() - Initializes and starts the network driver task.
+ * net_init() - Initializes and starts one network driver task per NIC queue.
  *
  * @net              network simulator configuration
  */
@@ -70,11 +232,49 @@ void net_init(net_t* net_ptr);
 
 /**
  * net_gpio_isr() - ISR that simulates packet receiption.
- * @packet      a pointer to a pointer of a simulated packet `trace_packet_t`
+ * @vector      interrupt vector that fired
+ *
+ * This is an ISR, added to every vector. It receives the IRQ in `shared`
+ * into the ingress path of the NIC queue the vector belongs to.
+ */
+void IRAM_ATTR net_gpio_isr(void *vector);
+
+/**
+ * net_vector() - interrupt vector the packets of a port arrive on
+ *
+ * The vector of the NIC queue the port is assigned to.
+ */
+int net_vector(unsigned short port);
+
+/**
+ * net_coalesce_start() - start on-device moderation
+ *
+ * Anchors the periodic flushes of all moderated queues at the trace start.
+ * Does nothing unless NIC_COALESCE is set.
+ */
+void net_coalesce_start(void);
+
+/**
+ * net_isr_cycles() - CPU cycles spent in the ISR of all vectors so far
+ *
+ * Safe on either core, the count is read under the lock the ISR updates
+ * it with, so it is never seen halfway.
+ */
+unsigned long long net_isr_cycles(void);
+
+/**
+ * net_print_stats() - print driver statistics to serial
+ *
+ * Lines are prefixed with '#' so they are not mistaken for result rows.
+ */
+void net_print_stats(void);
+
+/**
+ * net_print_mem() - print heap and static memory use to serial
  *
- * This is an ISR. It simulates a single packet by toggling a GPIO pin on/off.
+ * Meant to be called once all tasks have bound their sockets.
  */
-void IRAM_ATTR net_gpio_isr(void *packet);
+void net_print_mem(void);
 
 
 #endif
@@ -1,11 +1,55 @@
 #ifndef __NET_API__
 #define __NET_API__
 
+#include "freertos/FreeRTOS.h"
+
+
+/*
+ * Receive paths a packet can take through the driver.
+ */
+#define NET_PATH_NORMAL     0
+#define NET_PATH_EARLY      1
+#define NET_PATH_COUNT      2
+
+/*
+ * Reasons for the driver to drop a packet, recorded with the results.
+ */
+#define NET_DROP_NONE       0   /* packet was delivered */
+#define NET_DROP_NO_PBUF    1   /* packet buffer pool exhausted */
+#define NET_DROP_INGRESS    2   /* ingress queue of the NIC queue full */
+#define NET_DROP_NO_SOCK    3   /* no socket bound to the port */
+#define NET_DROP_SOCK_FULL  4   /* socket queue full, newest dropped */
+#define NET_DROP_EVICTED    5   /* socket queue full, oldest dropped */
+#define NET_DROP_COUNT      6
+
+/*
+ * Socket queue overflow policies, chosen per port in nic_config.h.
+ */
+#define NET_OVERFLOW_DROP_NEWEST    0
+#define NET_OVERFLOW_DROP_OLDEST    1
+
+/*
+ * Events reported by net_poll().
+ */
+#define NET_POLLIN          0x1
+
+
+/**
+ * net_pollfd_t - socket of interest for net_poll()
+ *
+ * @sock    socket to watch, must be owned by the polling task
+ * @revents filled in by net_poll(), NET_POLLIN if packets are queued
+ */
+typedef struct {
+    int sock;
+    int revents;
+} net_pollfd_t;
 
 /**
  * net_sock() - Creates a socket.
  *
  * Aquires a socket in the socket table and associates it with the process.
+ * Returns -1 once the socket table is full.
  */
 int net_sock(void);
 
@@ -16,7 +60,12 @@ int net_sock(void);
  * @port    which network port to bind socket to
  *
  * Bind a port to a socket associated with the process. The socket may be
- * used if the return value is 0.
+ * used if the return value is 0. Returns -1 for an invalid socket or one
+ * of another task, -2 if the port table has no free slot for the port, -3
+ * if the queue arena cannot hold the socket queue and -4 if another socket
+ * is bound to the port. The socket queue is sized by the port's depth from
+ * nic_config.h. Rebinding a socket releases its previous port, packets
+ * still queued for it are dropped if the new port needs another depth.
  */
 int net_bind(int sock, unsigned short port);
 
@@ -24,13 +73,85 @@ int net_bind(int sock, unsigned short port);
  * net_recv() - Receive data from port.
  *
  * @sock    socket that receives data for that port
- * @size    how much data to be received
+ * @buf     where to store the pointer to the received packet buffer
+ *
+ * Receives a packet blockingly. The function installs a callback in the
+ * socket table which is executed if a packet is received on that port.
+ * No data is copied, `buf` points into the driver's packet buffer pool
+ * and must be handed back with net_free() once the packet is processed.
+ * Returns the size of the packet, -1 for an invalid or unbound socket.
+ */
+int net_recv(int sock, void** buf);
+
+/**
+ * net_recvmmsg() - Receive a batch of packets from port.
+ *
+ * @sock    socket that receives data for that port
+ * @bufs    caller provided array to store packet buffer pointers in
+ * @count   capacity of `bufs`
+ * @timeout ticks to wait for the first packet, portMAX_DELAY blocks
+ *
+ * Waits for at least one packet and then takes up to `count` queued
+ * packets in the same wakeup. Every buffer must be handed back with
+ * net_free(). Returns the number of packets stored in `bufs`, 0 if the
+ * timeout expired and a negative value on error.
+ */
+int net_recvmmsg(int sock, void** bufs, int count, TickType_t timeout);
+
+/**
+ * net_poll() - Wait for packets on any of a set of sockets.
+ *
+ * @fds     sockets of interest
+ * @nfds    number of entries in `fds`
+ * @timeout ticks to wait for a socket to become ready, portMAX_DELAY blocks
+ *
+ * Lets one task serve many sockets. Each socket owns one bit of the task
+ * notification value, so a single wait covers all of them. Returns the
+ * number of ready sockets, 0 if the timeout expired or the task was
+ * kicked and a negative value if a socket is not owned by the calling
+ * task. Ready sockets are drained with net_recvmmsg() and a timeout of 0.
+ */
+int net_poll(net_pollfd_t* fds, int nfds, TickType_t timeout);
+
+/**
+ * net_poll_kick() - End the net_poll() of another task early.
+ *
+ * @task    task to wake up
+ *
+ * The net_poll() the task is blocked in, or its next one, returns as if
+ * its timeout expired, unless a socket is ready.
+ */
+void net_poll_kick(TaskHandle_t task);
+
+/**
+ * net_backlog() - Number of packets queued on a socket.
+ *
+ * @sock    socket of any task
+ *
+ * Returns a negative value if the socket is not bound.
+ */
+int net_backlog(int sock);
+
+/**
+ * net_steal() - Take packets queued on the socket of another task.
+ *
+ * @sock    socket of any task
+ * @bufs    caller provided array to store packet buffer pointers in
+ * @count   capacity of `bufs`
+ *
+ * Lets a pool of workers share the sockets of their ports. Never blocks
+ * and does not notify the owner. Buffers are handed back with net_free()
+ * like received ones. Returns the number of packets stored in `bufs` and
+ * a negative value if the socket is not bound.
+ */
+int net_steal(int sock, void** bufs, int count);
+
+/**
+ * net_free() - Return a received packet buffer to the driver.
  *
- * Receives `size` count of bytes blockingly. The function installs a
- * callback in the socket table which is executed if a packet is received
- * on that port.
+ * @buf     packet buffer obtained by net_recv()
  */
-int net_recv(int sock, void* dest, int size);
+void net_free(void* buf);
 
 
 #endif
@@ -0,0 +1,190 @@
+#ifndef __NIC_CONFIG__
+#define __NIC_CONFIG__
+
+
+/*
+ * Generated by config2header from experiments/no_dos/setting_2/config.json, do not edit.
+ */
+
+#define NIC_QUEUE_COUNT         4
+
+/*
+ * Per queue: { task name, net task priority, ingress queue depth,
+ *              early demux, net task core }
+ *
+ * Every NIC queue is served by its own ingress queue and net task. Early
+ * demux is meant for pass-through queues, their packets are put into the
+ * socket queue directly from the ISR.
+ */
+#define NIC_QUEUE_TABLE {               \
+    { "net-pt", 20, 0x100, 1, 0 },      \
+    { "net-buffer1", 19, 0x400, 0, 0 }, \
+    { "net-buffer2", 18, 0x400, 0, 0 }, \
+    { "net-buffer3", 17, 0x400, 0, 0 }, \
+}
+
+/*
+ * Per port: { port, queue, socket queue depth, overflow policy }. Ports
+ * not listed land in NIC_DEFAULT_QUEUE and get NIC_SOCK_DEPTH and
+ * NIC_SOCK_OVERFLOW. Overflow policy 0 drops the newest, 1 the oldest
+ * packet.
+ *
+ * The port demux table has 2^NIC_PORT_BITS slots, at least twice the
+ * listed ports and the ports of the spare sockets.
+ */
+#define NIC_PORT_COUNT          4
+#define NIC_PORT_BITS           4
+#define NIC_PORT_TABLE {                \
+    { 0, 0, 0x100, 0 },                 \
+    { 1, 1, 0x100, 0 },                 \
+    { 2, 2, 0x100, 0 },                 \
+    { 3, 3, 0x100, 0 },                 \
+}
+
+/*
+ * Per queue: { packet limit, packet time limit, absolute time limit,
+ *              absolute time limit offset, capacity }, times in
+ *              microseconds, capacity 0 for NET_COALESCE_RING.
+ *
+ * Interrupt moderation of the NIC simulator. With NIC_COALESCE set the
+ * firmware moderates on the device and the trace holds raw arrivals,
+ * otherwise the table is unused and the trace holds the simulated IRQs.
+ */
+#define NIC_COALESCE            0
+#define NIC_COALESCE_TABLE {            \
+    { 1, 0, 0, 0, 0 },                  \
+    { 0, 11000, 21000, 0, 128 },        \
+    { 0, 8000, 16000, 250, 128 },       \
+    { 0, 6000, 11000, 500, 128 },       \
+}
+
+#define NIC_DEFAULT_QUEUE       (NIC_QUEUE_COUNT - 1)
+#define NIC_SOCK_DEPTH          0x100
+#define NIC_SOCK_OVERFLOW       0
+
+/*
+ * Per worker: { task name, port, priority, core, deadline in us }
+ *
+ * Packets of a port with a deadline count as missed if their worker
+ * finishes them later than that after they were sent. With NIC_EDF the
+ * worker priorities are handed out by earliest absolute deadline instead
+ * of being fixed.
+ *
+ * The GPIO ISR is installed on NIC_ISR_CORE. The traffic generator and
+ * its timer ISR run on NIC_TRAFFIC_CORE, the generator sleeps between
+ * IRQs and only delays the tasks of its core while it arms the timer.
+ */
+#define NIC_WORKER_COUNT        4
+#define NIC_WORKER_TABLE {              \
+    { "WRK-1", 0, 14, 0, 0 },           \
+    { "WRK-2", 1, 13, 0, 0 },           \
+    { "WRK-3", 2, 12, 0, 0 },           \
+    { "WRK-4", 3, 11, 0, 0 },           \
+}
+#define NIC_EDF                 0
+
+/*
+ * Per poll worker: { task name, priority, core }
+ * Per worker of NIC_WORKER_TABLE: index of the poll worker serving its
+ * port instead, -1 if it has a worker of its own
+ */
+#define NIC_POLL_COUNT          0
+#define NIC_POLL_TABLE {                \
+    { 0 },                              \
+}
+#define NIC_POLL_GROUP_TABLE    { -1, -1, -1, -1 }
+
+/*
+ * Per pool worker: { task name, priority, core }
+ * Per worker of NIC_WORKER_TABLE: index of the pool worker its port is
+ * at home with
+ *
+ * With NIC_POOL the pool workers serve all ports instead of one worker
+ * per port. Idle pool workers take packets from ports with at least
+ * NIC_POOL_STEAL_MIN queued, ports at home on their own core first.
+ */
+#define NIC_POOL                0
+#define NIC_POOL_COUNT          2
+#define NIC_POOL_TABLE {                \
+    { "POOL-1", 14, 0 },                \
+    { "POOL-2", 14, 1 },                \
+}
+#define NIC_POOL_HOME_TABLE     { 0, 0, 0, 0 }
+#define NIC_POOL_STEAL_MIN      1
+
+/*
+ * With NIC_PRIO_BOOST every net task runs one priority above the highest
+ * priority worker waiting on a port of its queue and drops to a low
+ * priority while none waits, instead of its priority in NIC_QUEUE_TABLE.
+ */
+#define NIC_PRIO_BOOST          0
+
+#define NIC_ISR_CORE            0
+#define NIC_TRAFFIC_CORE        1
+#define NIC_TRAFFIC_PRIORITY    (configMAX_PRIORITIES - 1)
+
+/*
+ * Packet buffer pointer slots of the static queue arena: all ingress
+ * queues, all listed ports and 2 spare sockets of NIC_SOCK_DEPTH.
+ */
+#define NIC_ARENA_SLOTS         4864
+
+/*
+ * Packet buffers: one per arena slot, per packet held on the device and
+ * per packet in flight in a net task or a worker batch, so that drops are
+ * decided by the queue depths and overflow policies, never by the pool.
+ */
+#define NIC_PBUF_COUNT          4996
+
+/*
+ * Per port: { port, model, cycles, first and number of distribution rows }
+ * Per distribution row: { cycles, weight }
+ *
+ * Workload a packet of the port costs, see workload.h. Costs are CPU
+ * cycles, the kernels are calibrated at boot. Other ports keep the
+ * original binomial load.
+ */
+#define NIC_WORKLOAD_COUNT      0
+#define NIC_WORKLOAD_TABLE {            \
+    { 0 },                              \
+}
+#define NIC_WORKLOAD_DIST_COUNT 0
+#define NIC_WORKLOAD_DIST_TABLE {       \
+    { 0 },                              \
+}
+
+/*
+ * Per periodic task: { task name, period, WCET and deadline in us,
+ *                      priority, core }
+ *
+ * Released in phase once the replay starts, see periodic.h.
+ */
+#define NIC_PERIODIC_COUNT      0
+#define NIC_PERIODIC_TABLE {            \
+    { 0 },                              \
+}
+
+/*
+ * Results are streamed as COBS framed binary records, or as csv rows if
+ * set. run.py has to read the same format. NIC_EXPORT_HIST replaces the
+ * per packet results with per port latency and runtime histograms that
+ * are printed with the statistics, for runs of any length.
+ */
+#define NIC_EXPORT_TEXT         0
+#define NIC_EXPORT_HIST         0
+
+/*
+ * Replay speed factor in permille, every trace delta is divided by it.
+ * NIC_SEARCH repeats the trace, multiplying the speed by NIC_SEARCH_STEP
+ * (permille) after every pass without drops and within
+ * NIC_SEARCH_LATENCY_US (0 for no bound), up to NIC_SEARCH_MAX_SPEED.
+ * Only the passes and the sustainable rates are exported.
+ */
+#define NIC_REPLAY_SPEED        1000
+#define NIC_SEARCH              0
+#define NIC_SEARCH_STEP         1250
+#define NIC_SEARCH_MAX_SPEED    64000
+#define NIC_SEARCH_LATENCY_US   0
+
+
+#endif
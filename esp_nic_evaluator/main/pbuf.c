@@ -0,0 +1,75 @@
+#include "freertos/FreeRTOS.h"
+
+#include "pbuf.h"
+
+
+/**
+ * Statically allocated packet buffers. Only pointers into this pool are
+ * passed through the ingress and socket queues, the packet itself is
+ * written exactly once by the ISR.
+ */
+static trace_packet_t pbuf_pool[PBUF_COUNT];
+
+/**
+ * LIFO free list of buffers, protected by a spinlock since buffers are
+ * taken on the ISR core and returned by workers on any core.
+ */
+static trace_packet_t* pbuf_free_list[PBUF_COUNT];
+static int pbuf_free_top;
+static unsigned int pbuf_alloc_failed;
+static portMUX_TYPE pbuf_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+void
+pbuf_init
+(void)
+{
+    for (int i = 0; i < PBUF_COUNT; i++) {
+        pbuf_free_list[i] = &pbuf_pool[i];
+    }
+
+    pbuf_free_top = PBUF_COUNT;
+    pbuf_alloc_failed = 0;
+}
+
+trace_packet_t* IRAM_ATTR
+pbuf_alloc_from_isr
+(void)
+{
+    trace_packet_t* pbuf = NULL;
+
+    portENTER_CRITICAL_ISR(&pbuf_mux);
+    if (pbuf_free_top > 0) {
+        pbuf = pbuf_free_list[--pbuf_free_top];
+    } else {
+        pbuf_alloc_failed++;
+    }
+    portEXIT_CRITICAL_ISR(&pbuf_mux);
+
+    return pbuf;
+}
+
+void
+pbuf_free
+(trace_packet_t* pbuf)
+{
+    portENTER_CRITICAL(&pbuf_mux);
+    pbuf_free_list[pbuf_free_top++] = pbuf;
+    portEXIT_CRITICAL(&pbuf_mux);
+}
+
+void IRAM_ATTR
+pbuf_free_from_isr
+(trace_packet_t* pbuf)
+{
+    portENTER_CRITICAL_ISR(&pbuf_mux);
+    pbuf_free_list[pbuf_free_top++] = pbuf;
+    portEXIT_CRITICAL_ISR(&pbuf_mux);
+}
+
+unsigned int
+pbuf_exhausted
+(void)
+{
+    return pbuf_alloc_failed;
+}
@@ -0,0 +1,50 @@
+#ifndef __PBUF__
+#define __PBUF__
+
+#include "freertos/FreeRTOS.h"
+
+#include "traffic.h"
+#include "nic_config.h"
+
+
+/*
+ * The pool covers every queue slot and packet in flight, see
+ * NIC_PBUF_COUNT. An exhausted pool means the config is wrong.
+ */
+#define PBUF_COUNT          NIC_PBUF_COUNT
+
+
+/**
+ * pbuf_init() - Fills the free list with every buffer of the static pool.
+ *
+ * Must be called once before the packet ISR is installed.
+ */
+void pbuf_init(void);
+
+/**
+ * pbuf_alloc_from_isr() - Takes a packet buffer from the free list.
+ *
+ * This is safe to be called from an ISR. Returns NULL if the pool is
+ * exhausted, in which case the packet has to be dropped.
+ */
+trace_packet_t* IRAM_ATTR pbuf_alloc_from_isr(void);
+
+/**
+ * pbuf_free() - Returns a packet buffer to the free list.
+ * @pbuf    buffer previously handed out by pbuf_alloc_from_isr()
+ */
+void pbuf_free(trace_packet_t* pbuf);
+
+/**
+ * pbuf_free_from_isr() - ISR variant of pbuf_free().
+ * @pbuf    buffer previously handed out by pbuf_alloc_from_isr()
+ */
+void IRAM_ATTR pbuf_free_from_isr(trace_packet_t* pbuf);
+
+/**
+ * pbuf_exhausted() - Number of allocations that failed on an empty pool.
+ */
+unsigned int pbuf_exhausted(void);
+
+
+#endif
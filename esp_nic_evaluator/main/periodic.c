@@ -0,0 +1,191 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "periodic.h"
+#include "clock.h"
+#include "tasks.h"
+#include "workload.h"
+
+
+/**
+ * Tasks and their configuration.
+ */
+static periodic_t periodic[PERIODIC_MAX + 1];
+static const periodic_cfg_t periodic_cfg[NIC_PERIODIC_COUNT + 1] =
+    NIC_PERIODIC_TABLE;
+
+/**
+ * Release reference of the current run: the tick all tasks are released
+ * on and the clock stamp taken right after it.
+ */
+static TickType_t periodic_base_tick;
+static uint32_t periodic_base;
+static volatile int periodic_running;
+
+/**
+ * periodic_main() - activation loop of a periodic task
+ * @p       task struct
+ */
+static void periodic_main(periodic_t* p);
+
+/**
+ * periodic_account() - add the times of one activation
+ * @p       task struct
+ * @start   cycles from release to start
+ * @finish  cycles from release to finish
+ */
+static void periodic_account(periodic_t* p, uint32_t start, uint32_t finish);
+
+
+void
+periodic_init
+(void)
+{
+    for (int i = 0; i < NIC_PERIODIC_COUNT; i++) {
+        periodic_t* p = &periodic[i];
+        const periodic_cfg_t* cfg = &periodic_cfg[i];
+
+        p->cfg = cfg;
+        p->period_ticks = (cfg->period_us + 500) / 1000 / portTICK_PERIOD_MS;
+        if (!p->period_ticks)
+            p->period_ticks = 1;
+        p->period = p->period_ticks * portTICK_PERIOD_MS * 1000 *
+            CLOCK_CYCLES_US;
+        p->start_min = UINT32_MAX;
+        task_periodic[i] = &p->task;
+
+        p->task = xTaskCreateStaticPinnedToCore(
+            (TaskFunction_t)periodic_main,
+            cfg->name,
+            PERIODIC_STACK_SIZE,
+            p,
+            cfg->priority,
+            p->stack,
+            &p->tcb,
+            cfg->core
+        );
+    }
+}
+
+void
+periodic_start
+(void)
+{
+    if (!NIC_PERIODIC_COUNT)
+        return;
+
+    /* Line the reference up with a tick, the caller runs on top priority. */
+    vTaskDelay(1);
+    periodic_base = clock_now();
+    periodic_base_tick = xTaskGetTickCount();
+    periodic_running = 1;
+
+    for (int i = 0; i < NIC_PERIODIC_COUNT; i++)
+        xTaskNotifyGive(periodic[i].task);
+}
+
+void
+periodic_stop
+(void)
+{
+    periodic_running = 0;
+}
+
+static void
+periodic_main
+(periodic_t* p)
+{
+    ets_printf("Periodic task registered to core %d\n", xPortGetCoreID());
+
+    while (true) {
+        TickType_t wake;
+        uint32_t n = 0;
+
+        /* Sleep until the replay starts. */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        wake = periodic_base_tick;
+
+        while (true) {
+            vTaskDelayUntil(&wake, p->period_ticks);
+            if (!periodic_running)
+                break;
+            n++;
+
+            /* Stamps wrap, only their distance to the release counts. */
+            uint32_t release = periodic_base + n * p->period;
+            uint32_t start = clock_now();
+            workload_spin(p->cfg->wcet_us * CLOCK_CYCLES_US, n);
+            uint32_t finish = clock_now();
+
+            /*
+             * The reference was stamped by the traffic task after its own
+             * wakeup on the release tick, a task woken on the same tick
+             * may read the clock a few cycles earlier.
+             */
+            periodic_account(
+                p,
+                (int32_t)(start - release) < 0 ? 0 : start - release,
+                (int32_t)(finish - release) < 0 ? 0 : finish - release
+            );
+
+            /*
+             * Activations released before the current tick while this one
+             * ran are lost, like the samples of an overrunning control
+             * loop. One released on the current tick is still run.
+             */
+            TickType_t elapsed = xTaskGetTickCount() - periodic_base_tick;
+            uint32_t lost = elapsed ? (elapsed - 1) / p->period_ticks : 0;
+            if (lost > n) {
+                p->missed += lost - n;
+                n = lost;
+                wake = periodic_base_tick + n * p->period_ticks;
+            }
+        }
+    }
+}
+
+static void
+periodic_account
+(periodic_t* p, uint32_t start, uint32_t finish)
+{
+    unsigned int start_us = clock_us(start);
+    unsigned int response_us = clock_us(finish);
+
+    p->activations++;
+    if (response_us > p->cfg->deadline_us)
+        p->deadline_misses++;
+    hist_add(&p->response, response_us);
+    p->response_sum += response_us;
+    if (start_us < p->start_min)
+        p->start_min = start_us;
+    if (start_us > p->start_max)
+        p->start_max = start_us;
+}
+
+void
+periodic_print_stats
+(void)
+{
+    for (int i = 0; i < NIC_PERIODIC_COUNT; i++) {
+        periodic_t* p = &periodic[i];
+
+        if (!p->activations) {
+            ets_printf("# periodic task=%s activations=0\n", p->cfg->name);
+            continue;
+        }
+        ets_printf(
+            "# periodic task=%s core=%d prio=%d period_us=%u wcet_us=%u "
+            "deadline_us=%u activations=%u missed=%u deadline_misses=%u "
+            "response_mean_us=%u response_p99_us=%u response_max_us=%u "
+            "start_max_us=%u jitter_us=%u\n",
+            p->cfg->name, p->cfg->core, p->cfg->priority,
+            clock_us(p->period), p->cfg->wcet_us, p->cfg->deadline_us,
+            p->activations, p->missed, p->deadline_misses,
+            (unsigned int)(p->response_sum / p->activations),
+            hist_percentile(&p->response, 990), p->response.max,
+            p->start_max, p->start_max - p->start_min
+        );
+    }
+}
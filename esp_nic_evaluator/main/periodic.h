@@ -0,0 +1,111 @@
+#ifndef __PERIODIC__
+#define __PERIODIC__
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nic_config.h"
+#include "hist.h"
+
+
+#define PERIODIC_STACK_SIZE     0x800
+
+/*
+ * Periodic tasks of NIC_PERIODIC_TABLE, standing in for control loops
+ * that share the cores with the NIC. Every activation spends the WCET of
+ * its task on arithmetic. Periods are rounded to whole ticks, activations
+ * are released by the tick interrupt.
+ */
+#define PERIODIC_MAX            NIC_PERIODIC_COUNT
+
+
+/**
+ * struct periodic_cfg_t - periodic task, one entry of NIC_PERIODIC_TABLE
+ * @name            task name
+ * @period_us       activation period in us
+ * @wcet_us         CPU time every activation spends in us
+ * @deadline_us     relative deadline of an activation in us
+ * @priority        priority of the task
+ * @core            core the task is pinned to
+ */
+typedef struct periodic_cfg_t periodic_cfg_t;
+
+struct periodic_cfg_t {
+    const char* name;
+    unsigned int period_us;
+    unsigned int wcet_us;
+    unsigned int deadline_us;
+    int priority;
+    int core;
+};
+
+/**
+ * struct periodic_t - periodic task struct and its measurements
+ * @task            FreeRTOS task handle
+ * @tcb             FreeRTOS task tcb
+ * @stack           stack area used by the task
+ * @cfg             configuration of the task
+ * @period_ticks    period in ticks
+ * @period          period in clock cycles
+ * @activations     number of activations that ran
+ * @missed          number of activations skipped since an earlier one was
+ *                  still running at their release
+ * @deadline_misses number of activations that finished after their deadline
+ * @response        response times in us, release to finish
+ * @response_sum    sum of all response times in us
+ * @start_min       smallest delay from release to start in us
+ * @start_max       largest delay from release to start in us
+ */
+typedef struct periodic_t periodic_t;
+
+struct periodic_t {
+    TaskHandle_t task;
+    StaticTask_t tcb;
+    StackType_t stack[PERIODIC_STACK_SIZE];
+    const periodic_cfg_t* cfg;
+    TickType_t period_ticks;
+    uint32_t period;
+    unsigned int activations;
+    unsigned int missed;
+    unsigned int deadline_misses;
+    hist_t response;
+    unsigned long long response_sum;
+    unsigned int start_min;
+    unsigned int start_max;
+};
+
+
+/**
+ * periodic_init() - create the tasks of NIC_PERIODIC_TABLE
+ *
+ * The tasks wait for periodic_start(), so they only measure the
+ * interference of the replayed traffic.
+ */
+void periodic_init(void);
+
+/**
+ * periodic_start() - release the first activation of every task
+ *
+ * All tasks are released in phase on the next tick, which is also the
+ * reference the release times of all activations are computed from.
+ */
+void periodic_start(void);
+
+/**
+ * periodic_stop() - stop activating the tasks
+ *
+ * Activations that are already released still finish.
+ */
+void periodic_stop(void);
+
+/**
+ * periodic_print_stats() - print response time, jitter and misses per task
+ *
+ * Jitter is the spread of the delays from release to start.
+ */
+void periodic_print_stats(void);
+
+
+#endif
@@ -5,10 +5,13 @@
 #include "freertos/task.h"
 
 #include "worker.h"
+#include "nic_config.h"
 
 
-TaskHandle_t *task_net;
+TaskHandle_t *task_net[NIC_QUEUE_COUNT];
 TaskHandle_t *task_traffic;
 TaskHandle_t *task_worker[WORKER_COUNT];
+TaskHandle_t *task_export;
+TaskHandle_t *task_periodic[NIC_PERIODIC_COUNT + 1];
 
 #endif
@@ -10,24 +10,23 @@
 #include "driver/timer.h"
 #include "xtensa/core-macros.h"
 
+#include "net.h"
+#include "export.h"
+#include "nic_config.h"
+#include "vector.h"
 #include "tasks.h"
 #include "traffic.h"
 #include "trace.h"
+#include "workload.h"
+#include "clock.h"
+#include "usage.h"
+#include "deadline.h"
+#include "periodic.h"
 
 
 static const char* TAG = "TFC";
 
 
-extern int worker_count;
-
-/**
- * Store results of the experiment.
- */
-result_t *results;
-obs_t *obs_times;
-unsigned int obs_cycles = 0;
-TaskHandle_t xObs = NULL;
-
 /**
  * traffic_trace_reader() - trace converter worker loop
  *
@@ -36,50 +35,128 @@ TaskHandle_t xObs = NULL;
  */
 static void traffic_trace_reader(raw_trace_packet_t* trace);
 
+/**
+ * traffic_replay() - replay the IRQs of the trace once
+ * @trace   raw trace
+ * @speed   replay speed in permille
+ *
+ * Restarts the timer and returns once the last IRQ has been sent.
+ */
+static void traffic_replay(raw_trace_packet_t* trace, unsigned int speed);
+
+/**
+ * traffic_run_pass() - replay the trace and wait for all of its results
+ * @trace   raw trace
+ * @speed   replay speed in permille
+ * @pass    number of the pass, starting at 1
+ *
+ * Returns whether the pass had no drops and kept NIC_SEARCH_LATENCY_US.
+ */
+static int traffic_run_pass(raw_trace_packet_t* trace, unsigned int speed,
+        int pass);
+
 /**
  * traffic_send_packet() - trigger transmission simulation of a packet
  *
- * A gpio will be toggled in order to trigger an isr that enqueues a packet.
+ * The line of the packet's vector will be toggled in order to trigger an
+ * isr that enqueues the packet.
  */
 static void traffic_send_packet(void);
 
+/**
+ * traffic_fire() - stamp and send the IRQ in `shared`
+ * @now     timer ticks since the trace start
+ *
+ * Called from the timer ISR, or from the trace reader for late IRQs.
+ * Accounts the drift of the IRQ against its due time.
+ */
+static void traffic_fire(uint64_t now);
+
+/**
+ * traffic_arm() - arm the timer alarm for the IRQ in `shared`
+ * @due     absolute due time in timer ticks since the trace start
+ *
+ * IRQs that are already due are sent right away, or spaced and
+ * re-anchored following the TRAFFIC_CATCHUP_* rules.
+ */
+static void traffic_arm(uint64_t due);
+
+/**
+ * traffic_timer_init() - set up the timer and its ISR
+ *
+ * Must run on the core that should serve the timer ISR.
+ */
+static void traffic_timer_init(void);
+
 /**
  * traffic_check_done() - check whether the trace and the worker are done
+ * @passes  number of trace replays so far
  *
  * The worker might take significant longer time than the traffic generator.
+ * Every packet is done once it was either received or dropped.
  */
-static int traffic_check_done(void);
+static int traffic_check_done(int passes);
 
 /**
- * traffic_print_results() - print the results to serial
+ * traffic_print_results() - finish the results on serial
  *
- * A function that transmit the results in csv format via the serial line.
+ * Waits for the streamed results to be written out and prints the
+ * statistics of all modules.
  */
 static void traffic_print_results(void);
 
 /**
- * traffic_gpio_init() - initialize traffic generator gpios
+ * traffic_print_drift() - print how faithfully the trace was replayed
+ *
+ * Drift is the time between the due time of an IRQ in the trace and the
+ * moment its edge was raised.
+ */
+static void traffic_print_drift(void);
+
+/**
+ * traffic_print_search() - print the highest sustained replay speed
+ * @speed   sustained speed in permille, 0 if none was
+ * @span    measured length of the pass at `speed` in timer ticks
  *
- * Applies pin configurations for gpio pins.
+ * Rates are those actually offered in that pass.
+ */
+static void traffic_print_search(unsigned int speed, uint64_t span);
+
+
+/**
+ * Vector of the NIC queue the IRQ in flight belongs to.
+ */
+static int traffic_vector;
+
+/**
+ * Keeps reading the timer and arming the alarm free of interruptions.
  */
-static void traffic_gpio_init(void);
+static portMUX_TYPE traffic_timer_mux = portMUX_INITIALIZER_UNLOCKED;
 
+/**
+ * Replay state in timer ticks: due time of the IRQ in flight, send time of
+ * the previous IRQ and the total shift of all re-anchors.
+ */
+static uint64_t traffic_due;
+static uint64_t traffic_last;
+static uint64_t traffic_shift;
 
 /**
- * Internal edge tracking variable.
+ * Per IRQ drift between due and send time.
  */
-static uint32_t __edge;
+static unsigned int traffic_drift_hist[TRAFFIC_DRIFT_BUCKETS];
+static unsigned long long traffic_drift_sum;
+static unsigned int traffic_drift_max;
+static unsigned int traffic_irqs;
+static unsigned int traffic_late;
+static unsigned int traffic_reanchors;
 
 /**
- * Configure the TRAFFIC_PIN that conveys the packet signal.
+ * IRQs of the current pass sent more than TRAFFIC_SEARCH_DRIFT_US late,
+ * and its largest drift in us.
  */
-static gpio_config_t traffic_gpio_cfg = {
-    .mode = GPIO_MODE_OUTPUT,
-    .intr_type = GPIO_PIN_INTR_DISABLE,
-    .pin_bit_mask = TRAFFIC_PIN_MASK,
-    .pull_up_en = 0,
-    .pull_down_en = 0
-};
+static unsigned int traffic_pass_late;
+static unsigned int traffic_pass_drift_max;
 
 
 void
@@ -92,14 +169,8 @@ traffic_init
     /* Convert trace. */
     raw_trace_packet_t* raw_packet_trace = (raw_trace_packet_t*)trace;
 
-    /* Aquire space for the results. */
-    results = (result_t*)malloc(sizeof(result_t) * TRACE_PACKET_COUNT);
-    obs_times = (obs_t*)malloc(sizeof(obs_t) * 1000);
-    /* Initialize gpio & timer. */
-    __edge = 0;
-    traffic_gpio_init();
-
-    /* Traffec geeration to CPU TRAFFIC_CORE. */
+    /* Vector lines belong to the driver, the timer to the trace reader. */
+    /* Traffic generation to CPU NIC_TRAFFIC_CORE. */
     t->task = NULL;
     task_traffic = &t->task;
 
@@ -108,10 +179,10 @@ traffic_init
         TRAFFIC_TASK_NAME,
         TRAFFIC_STACK_SIZE,
         raw_packet_trace,
-        configMAX_PRIORITIES-1,
+        NIC_TRAFFIC_PRIORITY,
         t->stack,
         &t->tcb,
-        TRAFFIC_CORE
+        NIC_TRAFFIC_CORE
     );
 }
 
@@ -120,10 +191,9 @@ IRAM_ATTR
 traffic_trace_reader
 (raw_trace_packet_t* trace)
 {
-    int lol = 0;
-    static uint32_t notified = 1;
-    long sent = 0;
-    long notify_delay = 0;
+    unsigned int speed = NIC_REPLAY_SPEED;
+    unsigned int sustained = 0;
+    uint64_t sustained_span = 0;
 
     ESP_LOGI(
         TAG, "Trace consists of %d packets in %d irqs.",
@@ -133,61 +203,38 @@ traffic_trace_reader
     /* Let the other tasks get ready. */
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-    /* Start Observed Task */
-    // vTaskResume(xObs);
+    /* Release the periodic tasks into the replayed load. */
+    periodic_start();
 
-    /* Loop through the irqs of the trace. */
-    for (int i = 0; i < TRACE_IRQ_COUNT; i++) {
+    traffic_timer_init();
 
-        /* Wait indefinetely till the ISR stops using the previous packet. */
-        if (notified) {
-
-            /* Make it available to the ISR to be enqueued in the driver. */
-            shared.port = trace[i].port;
-            shared.delta = trace[i].delta;
-            shared.count = trace[i].count;
-
-            /* Sleep for the specified duration. */
-            lol += shared.delta;
-            ESP_LOGI(TAG, "delta => %hu, sum => %d", shared.delta, lol);
-
-            long remaining_delta = shared.delta - notify_delay;
-            if(remaining_delta > 0){
-                ets_delay_us(remaining_delta);
-                // ets_delay_us(1000);
-            }//else{
-            //  ets_printf("Warning: Previous ISR not fast enough by %ld us", remaining_delta);
-            //}
-
-            /* Measure and save transmission start time for packets in IRQ. */
-            sent = esp_timer_get_time();
-            for(int k=0; k<shared.count; k++) {
-                results[shared.seq + k].sent = sent;
-            }
-
-            /* Wiggle the gpio pin. */
-            traffic_send_packet();
-
-            // ESP_LOGI(
-            //     TAG, "sq=%d, tx=%ld, d=%hu, p=%u, c=%u (%d)",
-            //     i, sent, shared.delta, shared.port, shared.count, shared.seq
-            // );
-        }
+    /* Replay once, or at rising speed until the trace is not sustained. */
+    for (int pass = 1; ; pass++) {
+        unsigned int next;
 
-        /* Wait for the packet being put into the ingress queue. */
-        notified = ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
-        notify_delay = esp_timer_get_time() - sent;
+        if (!traffic_run_pass(trace, speed, pass) || !NIC_SEARCH)
+            break;
+        sustained = speed;
+        sustained_span = traffic_last;
+
+        next = (unsigned long long)speed * NIC_SEARCH_STEP / TRAFFIC_SPEED_UNIT;
+        if (next > NIC_SEARCH_MAX_SPEED)
+            next = NIC_SEARCH_MAX_SPEED;
+        if (next <= speed)
+            break;
+        speed = next;
+
+        vTaskDelay(TRAFFIC_PASS_PAUSE_MS / portTICK_PERIOD_MS);
     }
 
-    /* Wait an arbitrary amount of time before write out results. */
-    while (!traffic_check_done())
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+    if (NIC_SEARCH)
+        traffic_print_search(sustained, sustained_span);
 
     /* Worker grace time. */
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-    /* Stop Observed Task */
-    // vTaskSuspend(xObs);
+    /* Stop the periodic tasks. */
+    periodic_stop();
 
     /* Print results to serial line. */
     traffic_print_results();
@@ -197,57 +244,250 @@ traffic_trace_reader
         vTaskDelay(10000 / portTICK_PERIOD_MS);
 }
 
+static int
+traffic_run_pass
+(raw_trace_packet_t* trace, unsigned int speed, int pass)
+{
+    export_pass_t result;
+    int ok;
+
+    export_pass_start();
+    traffic_replay(trace, speed);
+
+    /* Wait an arbitrary amount of time before write out results. */
+    while (!traffic_check_done(pass))
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+
+    export_pass(&result);
+    ok = !result.drops && (!NIC_SEARCH_LATENCY_US ||
+        result.latency_max <= NIC_SEARCH_LATENCY_US) &&
+        (unsigned long long)traffic_pass_late * 1000 <=
+        (unsigned long long)TRACE_IRQ_COUNT * TRAFFIC_SEARCH_LATE_PERMILLE;
+
+    if (NIC_SEARCH) {
+        ets_printf(
+            "# search pass=%d speed_permille=%u span_us=%llu packets=%u "
+            "drops=%u max_latency_us=%u late_irqs=%u max_drift_us=%u ok=%d\n",
+            pass, speed, traffic_last / TRAFFIC_TIMER_TICKS_US,
+            result.packets, result.drops, result.latency_max,
+            traffic_pass_late, traffic_pass_drift_max, ok
+        );
+    }
+
+    return ok;
+}
+
 static void
-traffic_send_packet
-(void)
+IRAM_ATTR
+traffic_replay
+(raw_trace_packet_t* trace, unsigned int speed)
 {
-    if (__edge) {
-        gpio_set_level(TRAFFIC_PIN, 0);
-        __edge = 0;
-    } else {
-        gpio_set_level(TRAFFIC_PIN, 1);
-        __edge = 1;
+    unsigned long long elapsed = 0;
+
+    /* Anchor on-device interrupt moderation at the trace start. */
+    net_coalesce_start();
+
+    /* The trace starts now, the timer counts from here. */
+    portENTER_CRITICAL(&traffic_timer_mux);
+    timer_set_counter_value(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, 0);
+    traffic_last = 0;
+    traffic_shift = 0;
+    traffic_pass_late = 0;
+    traffic_pass_drift_max = 0;
+    portEXIT_CRITICAL(&traffic_timer_mux);
+
+    /* Loop through the irqs of the trace. */
+    for (int i = 0; i < TRACE_IRQ_COUNT; i++) {
+        uint64_t due;
+
+        /* Make it available to the ISR to be enqueued in the driver. */
+        shared.port = trace[i].port;
+        shared.delta = trace[i].delta;
+        shared.count = trace[i].count;
+        traffic_vector = net_vector(shared.port);
+
+        /*
+         * Due times are absolute, a late IRQ does not shift the ones after
+         * it and neither errors nor the rounding of scaled deltas add up
+         * over the trace.
+         */
+        elapsed += shared.delta;
+        due = elapsed * TRAFFIC_TIMER_TICKS_US * TRAFFIC_SPEED_UNIT / speed;
+        ESP_LOGI(TAG, "delta => %u, due => %llu", shared.delta, due);
+        traffic_arm(due);
+
+        /* Sleep till the packets have been put into the ingress queue. */
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
     }
 }
 
-static int
-traffic_check_done
+static void IRAM_ATTR
+traffic_send_packet
 (void)
 {
-    int i = TRACE_PACKET_COUNT - worker_count;
+    vector_raise(traffic_vector);
+}
 
-    for (;i < TRACE_PACKET_COUNT - 1; i++) {
-        if (!results[i].received) {
-            return 0;
-        }
+static void IRAM_ATTR
+traffic_fire
+(uint64_t now)
+{
+    /* IRQs within the margin may go out a little early. */
+    unsigned int drift = now > traffic_due ?
+        (now - traffic_due) / TRAFFIC_TIMER_TICKS_US : 0;
+    int bucket = drift ? 32 - __builtin_clz(drift) : 0;
+
+    if (bucket >= TRAFFIC_DRIFT_BUCKETS)
+        bucket = TRAFFIC_DRIFT_BUCKETS - 1;
+    traffic_drift_hist[bucket]++;
+    traffic_drift_sum += drift;
+    if (drift > traffic_drift_max)
+        traffic_drift_max = drift;
+    if (drift > traffic_pass_drift_max)
+        traffic_pass_drift_max = drift;
+    if (drift > TRAFFIC_SEARCH_DRIFT_US)
+        traffic_pass_late++;
+    traffic_irqs++;
+    traffic_last = now;
+
+    /* Measure transmission start time, the ISR copies it to each packet. */
+    shared.sent = clock_now();
+
+    /* Wiggle the gpio pin. */
+    traffic_send_packet();
+}
+
+void IRAM_ATTR
+traffic_timer_isr
+(void *id)
+{
+    uint64_t now =
+        timer_group_get_counter_value_in_isr(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER);
+
+    timer_group_clr_intr_status_in_isr(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER);
+    traffic_fire(now);
+}
+
+static void
+traffic_arm
+(uint64_t due)
+{
+    uint64_t now;
+    uint64_t at;
+    int late;
+
+    portENTER_CRITICAL(&traffic_timer_mux);
+    timer_get_counter_value(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, &now);
+    due += traffic_shift;
+
+    /* Far too late, move the rest of the trace instead of bursting. */
+    if (TRAFFIC_CATCHUP_MAX_US &&
+            due + TRAFFIC_CATCHUP_MAX_US * TRAFFIC_TIMER_TICKS_US < now) {
+        traffic_shift += now - due;
+        due = now;
+        traffic_reanchors++;
     }
+    traffic_due = due;
+
+    /* Space late IRQs while catching up. */
+    at = due;
+    if (due < now + TRAFFIC_TIMER_MARGIN) {
+        traffic_late++;
+        if (at < traffic_last + TRAFFIC_CATCHUP_GAP_US * TRAFFIC_TIMER_TICKS_US)
+            at = traffic_last + TRAFFIC_CATCHUP_GAP_US * TRAFFIC_TIMER_TICKS_US;
+    }
+
+    late = at < now + TRAFFIC_TIMER_MARGIN;
+    if (!late) {
+        timer_set_alarm_value(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, at);
+        timer_set_alarm(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, TIMER_ALARM_EN);
+    }
+    portEXIT_CRITICAL(&traffic_timer_mux);
 
-    return 1;
+    if (late)
+        traffic_fire(now);
+}
+
+static void
+traffic_timer_init
+(void)
+{
+    timer_config_t config = {
+        .divider = TIMER_BASE_CLK / TRAFFIC_TIMER_SCALE,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+    };
+
+    timer_init(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, &config);
+    timer_enable_intr(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER);
+
+    /* The ISR is served by the core registering it. */
+    timer_isr_register(
+        TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER, traffic_timer_isr, NULL, 0, NULL
+    );
+    timer_start(TRAFFIC_TIMER_GROUP, TRAFFIC_TIMER);
+}
+
+static int
+traffic_check_done
+(int passes)
+{
+    return export_completed() >= (unsigned int)passes * TRACE_PACKET_COUNT;
 }
 
 static void
 traffic_print_results
 (void)
 {
-    ets_printf("seq, sent, recv, tx_delay, runtime\n");
-    for(int i = 0; i < TRACE_PACKET_COUNT; i++) {
-        unsigned int tx_delay = results[i].received - results[i].sent;
-        ets_printf(
-            "%d, %u, %u, %u, %u\n",
-            i, results[i].sent, results[i].received, tx_delay, results[i].runtime
-        );
-    }
+    export_flush();
+    export_print_stats();
+    traffic_print_drift();
+    net_print_stats();
+    worker_print_stats();
+    deadline_print_stats();
+    workload_print_stats();
+    periodic_print_stats();
+    usage_print_stats();
     ets_printf("END\n");
-    // for(int i = 0; i < obs_cycles; i++) {
-    //     ets_printf("%d: %u\n", i, obs_times[i].runtime);
-    // }
-    // ets_printf("END\n");
 }
 
 static void
-traffic_gpio_init
+traffic_print_drift
 (void)
 {
-    /* Apply config for TRAFFIC_PIN */
-    gpio_config(&traffic_gpio_cfg);
+    ets_printf(
+        "# drift irqs=%u late=%u reanchors=%u shift_us=%llu mean_us=%u "
+        "max_us=%u\n",
+        traffic_irqs, traffic_late, traffic_reanchors,
+        traffic_shift / TRAFFIC_TIMER_TICKS_US,
+        (unsigned int)(traffic_irqs ? traffic_drift_sum / traffic_irqs : 0),
+        traffic_drift_max
+    );
+
+    for (int i = 0; i < TRAFFIC_DRIFT_BUCKETS; i++) {
+        if (traffic_drift_hist[i]) {
+            ets_printf(
+                "# drift below_us=%u count=%u\n",
+                1U << i, traffic_drift_hist[i]
+            );
+        }
+    }
+}
+
+static void
+traffic_print_search
+(unsigned int speed, uint64_t span)
+{
+    /* Rates over the timer span from the pass start to its last IRQ. */
+    ets_printf(
+        "# search max_speed_permille=%u span_us=%llu irqs_per_s=%llu "
+        "packets_per_s=%llu\n",
+        speed, span / TRAFFIC_TIMER_TICKS_US,
+        span ? (unsigned long long)TRACE_IRQ_COUNT * TRAFFIC_TIMER_TICKS_US *
+            1000000 / span : 0,
+        span ? (unsigned long long)TRACE_PACKET_COUNT * TRAFFIC_TIMER_TICKS_US *
+            1000000 / span : 0
+    );
 }
@@ -7,15 +7,62 @@
 #include "freertos/task.h"
 
 #include "driver/gpio.h"
+#include "driver/timer.h"
 
 
-#define TRAFFIC_PIN               GPIO_NUM_18
-#define TRAFFIC_PIN_MASK          (1ULL << TRAFFIC_PIN)
-#define TRAFFIC_CORE              1
 #define TRAFFIC_TASK_NAME         "traffic"
 #define TRAFFIC_STACK_SIZE        0x1000
+
+/*
+ * Timer raising the packet edges, TIMER_GROUP_0 is taken by esp_timer.
+ * It counts TRAFFIC_TIMER_SCALE ticks per second from the trace start.
+ */
+#define TRAFFIC_TIMER_GROUP       TIMER_GROUP_1
+#define TRAFFIC_TIMER             TIMER_0
 #define TRAFFIC_TIMER_SCALE       40000000
-#define TRAFFIC_TIMER_INITIAL     (10 * TRAFFIC_TIMER_SCALE)
+#define TRAFFIC_TIMER_TICKS_US    (TRAFFIC_TIMER_SCALE / 1000000)
+
+/*
+ * IRQs due within this many ticks are sent right away, an alarm armed
+ * that close could be passed before it is enabled.
+ */
+#define TRAFFIC_TIMER_MARGIN      (2 * TRAFFIC_TIMER_TICKS_US)
+
+/*
+ * Catch-up of late IRQs. Late IRQs are sent at least TRAFFIC_CATCHUP_GAP_US
+ * apart, 0 sends them back to back until the replay is back on time. An
+ * IRQ more than TRAFFIC_CATCHUP_MAX_US late re-anchors the rest of the
+ * trace at its send time instead of bursting, 0 never re-anchors.
+ */
+#define TRAFFIC_CATCHUP_GAP_US    0
+#define TRAFFIC_CATCHUP_MAX_US    0
+
+/*
+ * Drift histogram, bucket 0 counts IRQs sent less than 1us after their
+ * due time, bucket n those sent [2^(n-1), 2^n) us late.
+ */
+#define TRAFFIC_DRIFT_BUCKETS     24
+
+/*
+ * Replay speeds are given in permille, trace deltas are divided by
+ * speed / TRAFFIC_SPEED_UNIT.
+ */
+#define TRAFFIC_SPEED_UNIT        1000
+
+/*
+ * Pause between two passes of a saturation search, so that the queues of
+ * a failed pass drain before the next one starts.
+ */
+#define TRAFFIC_PASS_PAUSE_MS     1000
+
+/*
+ * The replay waits for every IRQ to be sent, so at speeds the generator
+ * cannot keep up with IRQs simply go out late. A search pass only counts
+ * as sustained if at most TRAFFIC_SEARCH_LATE_PERMILLE of its IRQs were
+ * sent more than TRAFFIC_SEARCH_DRIFT_US after their due time.
+ */
+#define TRAFFIC_SEARCH_DRIFT_US   100
+#define TRAFFIC_SEARCH_LATE_PERMILLE 10
 
 
 /**
@@ -61,47 +108,63 @@ struct __attribute__((__packed__)) raw_trace_packet_t {
  * @seq             packet sequence number
  * @delta           time between two packets in choses resolution
  * @port            target port of the packet
+ * @path            receive path the driver took (NET_PATH_*)
+ * @sent            clock stamp when the packet has been sent
+ * @isr             clock stamp when the ISR of its IRQ was entered
+ * @dequeue         clock stamp when it left the ingress queue
  *
  * Additionally to the values of `raw_trace_packet_t` a sequence number
- * can be assigned during the processing of the raw packet trace.
+ * can be assigned during the processing of the raw packet trace. The
+ * stamps travel with the packet so no per-packet table is needed.
  */
 typedef struct trace_packet_t trace_packet_t;
 
 struct __attribute__((__packed__)) trace_packet_t {
     unsigned int seq;
+    unsigned int sent;
+    unsigned int isr;
+    unsigned int dequeue;
     unsigned int delta;
-    unsigned char port;
+    unsigned short port;
     unsigned char count;
+    unsigned char path;
 };
 
 /**
- * struct trace_packet_t - trace packet struct
- * @sent            time when the packet has been sent
- * @received        time the worker took the packet from his queue
+ * struct result_t - packet result struct
+ * @seq             packet sequence number
+ * @port            port the packet was sent to
+ * @sent            clock stamp when the packet has been sent
+ * @isr             clock stamp when the ISR of its IRQ was entered
+ * @dequeue         clock stamp when it left the ingress queue
+ * @wakeup          clock stamp when the worker woke up for it
+ * @received        clock stamp when the worker took it from his queue
+ * @runtime         clock cycles the worker spent processing the packet
+ * @drop            reason the driver dropped the packet (NET_DROP_*)
  *
  * Sending text over the serial line takes a lot of time and processing power
- * therefore the data is stores as a result and sent when the simulation has
- * finished.
+ * therefore results are queued and written out by a low priority task,
+ * which also converts the stamps (see clock.h) to times.
  */
 typedef struct result_t result_t;
 
 struct __attribute__((__packed__)) result_t {
+    unsigned int seq;
+    unsigned short port;
     unsigned int sent;
+    unsigned int isr;
+    unsigned int dequeue;
+    unsigned int wakeup;
     unsigned int received;
     unsigned int runtime;
-};
-
-typedef struct obs_t obs_t;
-
-struct __attribute__((__packed__)) obs_t {
-    unsigned int runtime;
+    unsigned char drop;
 };
 
 /**
  * traffic_init() - initialize and start trace to traffic conversion.
  *
  * the traffic module initializes a task that configures a timer interrupt
- * repeatedly based on the time delta of the next packet in the trace blob..
+ * repeatedly based on the time delta of the next packet in the trace blob.
  */
 void traffic_init(traffic_t* t);
 
@@ -110,7 +173,8 @@ void traffic_init(traffic_t* t);
  * @id      Receive the interrupt identifier.
  *
  * This is an ISR. It simulates a single packet by toggling the correct  GPIO
- * pin on/off based on the underlying trace.
+ * pin on/off based on the underlying trace once the alarm for the IRQ that
+ * is currently in `shared` fires.
  */
 void IRAM_ATTR traffic_timer_isr(void *id);
 
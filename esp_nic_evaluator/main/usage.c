@@ -0,0 +1,200 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "usage.h"
+#include "clock.h"
+#include "net.h"
+#include "tasks.h"
+
+
+/**
+ * Accounted tasks.
+ */
+static usage_entry_t usage_entry[USAGE_TASKS];
+static int usage_count;
+
+/**
+ * Busy time of the ISR since the first sample in us, and its cycle count
+ * at the previous sample.
+ */
+static unsigned long long usage_isr_busy;
+static unsigned long long usage_isr_last;
+
+/**
+ * Timeline: share of a core per period in permille, per task and in the
+ * last column for the ISR.
+ */
+static uint16_t usage_timeline[USAGE_SAMPLES][USAGE_TASKS + 1];
+static unsigned int usage_periods;
+static int64_t usage_first;
+static int64_t usage_last;
+
+/**
+ * usage_main() - sampler task loop
+ */
+static void usage_main(void* arg);
+
+/**
+ * usage_track() - add a task to the accounted ones
+ * @task    task handle, tasks that were never created are skipped
+ * @stage   stage the task is accounted to
+ */
+static void usage_track(TaskHandle_t task, int stage);
+
+/**
+ * usage_sample() - read all counters and close the current period
+ * @record  add the period to the timeline, the first sample only sets
+ *          the baseline
+ */
+static void usage_sample(int record);
+
+
+void
+usage_init
+(usage_t* u)
+{
+    for (int q = 0; q < NIC_QUEUE_COUNT; q++)
+        usage_track(task_net[q] ? *task_net[q] : NULL, USAGE_STAGE_NET);
+    for (int i = 0; i < WORKER_COUNT; i++)
+        usage_track(task_worker[i] ? *task_worker[i] : NULL,
+            USAGE_STAGE_WORKER);
+    usage_track(task_traffic ? *task_traffic : NULL, USAGE_STAGE_TRAFFIC);
+    usage_track(task_export ? *task_export : NULL, USAGE_STAGE_EXPORT);
+    for (int i = 0; i < NIC_PERIODIC_COUNT; i++)
+        usage_track(task_periodic[i] ? *task_periodic[i] : NULL,
+            USAGE_STAGE_PERIODIC);
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        usage_track(xTaskGetIdleTaskHandleForCPU(core), USAGE_STAGE_IDLE);
+
+    /* Pinned to the core its priority is chosen for, see USAGE_PRIORITY. */
+    u->task = xTaskCreateStaticPinnedToCore(
+        (TaskFunction_t)usage_main,
+        USAGE_TASK_NAME,
+        USAGE_STACK_SIZE,
+        NULL,
+        USAGE_PRIORITY,
+        u->stack,
+        &u->tcb,
+        NIC_ISR_CORE
+    );
+}
+
+static void
+usage_track
+(TaskHandle_t task, int stage)
+{
+    usage_entry_t* e;
+
+    if (task == NULL || usage_count >= USAGE_TASKS)
+        return;
+
+    e = &usage_entry[usage_count++];
+    e->task = task;
+    e->name = pcTaskGetTaskName(task);
+    e->stage = stage;
+    e->core = xTaskGetAffinity(task);
+}
+
+static void
+usage_main
+(void* arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+
+    usage_sample(0);
+    while (true) {
+        vTaskDelayUntil(&wake, USAGE_PERIOD_MS / portTICK_PERIOD_MS);
+        usage_sample(1);
+    }
+}
+
+static void
+usage_sample
+(int record)
+{
+    int64_t now = esp_timer_get_time();
+    unsigned long long isr = net_isr_cycles();
+    uint32_t period = now - usage_last;
+    uint16_t* row = NULL;
+
+    if (record && usage_periods < USAGE_SAMPLES && period)
+        row = usage_timeline[usage_periods];
+
+    for (int i = 0; i < usage_count; i++) {
+        usage_entry_t* e = &usage_entry[i];
+        TaskStatus_t status;
+        uint32_t busy;
+
+        vTaskGetInfo(e->task, &status, pdFALSE, eRunning);
+        busy = status.ulRunTimeCounter - e->last;
+        e->last = status.ulRunTimeCounter;
+        if (!record)
+            continue;
+
+        e->busy += busy;
+        if (row)
+            row[i] = (unsigned long long)busy * 1000 / period;
+    }
+
+    if (record) {
+        uint32_t busy = (isr - usage_isr_last) / CLOCK_CYCLES_US;
+
+        usage_isr_busy += busy;
+        if (row)
+            row[USAGE_TASKS] = (unsigned long long)busy * 1000 / period;
+        usage_periods++;
+    } else {
+        usage_first = now;
+    }
+
+    usage_isr_last = isr;
+    usage_last = now;
+}
+
+void
+usage_print_stats
+(void)
+{
+    static const char* stages[USAGE_STAGES] = {
+        "isr", "net", "worker", "traffic", "export", "idle", "periodic"
+    };
+    unsigned long long stage_busy[USAGE_STAGES] = {0};
+    unsigned int periods = usage_periods < USAGE_SAMPLES ?
+        usage_periods : USAGE_SAMPLES;
+
+    for (unsigned int p = 0; p < periods; p++) {
+        ets_printf("# usage second=%u isr=%u", p + 1,
+            usage_timeline[p][USAGE_TASKS]);
+        for (int i = 0; i < usage_count; i++) {
+            ets_printf(" %s/%d=%u", usage_entry[i].name, usage_entry[i].core,
+                usage_timeline[p][i]);
+        }
+        ets_printf("\n");
+    }
+
+    stage_busy[USAGE_STAGE_ISR] = usage_isr_busy;
+    ets_printf(
+        "# usage task=isr core=%d stage=isr busy_us=%llu\n",
+        NIC_ISR_CORE, usage_isr_busy
+    );
+    for (int i = 0; i < usage_count; i++) {
+        usage_entry_t* e = &usage_entry[i];
+
+        stage_busy[e->stage] += e->busy;
+        ets_printf(
+            "# usage task=%s core=%d stage=%s busy_us=%llu\n",
+            e->name, e->core, stages[e->stage], e->busy
+        );
+    }
+
+    for (int s = 0; s < USAGE_STAGES; s++) {
+        ets_printf(
+            "# usage stage=%s busy_us=%llu span_us=%llu\n",
+            stages[s], stage_busy[s],
+            (unsigned long long)(usage_last - usage_first)
+        );
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef __USAGE__
+#define __USAGE__
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nic_config.h"
+#include "worker.h"
+
+
+#define USAGE_TASK_NAME     "usage"
+#define USAGE_STACK_SIZE    0x800
+
+/*
+ * The sampler only reads counters once per period, it runs above every
+ * net task and worker of NIC_ISR_CORE so that samples are taken on time.
+ */
+#define USAGE_PRIORITY      (configMAX_PRIORITIES - 2)
+#define USAGE_PERIOD_MS     1000
+
+/*
+ * Samples kept for the timeline, later periods only count in the totals.
+ */
+#define USAGE_SAMPLES       300
+
+/*
+ * Accounted tasks: the net task of every queue, every worker, the
+ * traffic generator, the export task, every periodic task and the idle
+ * task of every core.
+ */
+#define USAGE_TASKS                                                     \
+    (NIC_QUEUE_COUNT + WORKER_COUNT + 2 + NIC_PERIODIC_COUNT +          \
+        portNUM_PROCESSORS)
+
+/*
+ * Stages tasks are accounted to. The ISR is a stage of its own.
+ */
+#define USAGE_STAGE_ISR     0
+#define USAGE_STAGE_NET     1
+#define USAGE_STAGE_WORKER  2
+#define USAGE_STAGE_TRAFFIC 3
+#define USAGE_STAGE_EXPORT  4
+#define USAGE_STAGE_IDLE    5
+#define USAGE_STAGE_PERIODIC 6
+#define USAGE_STAGES        7
+
+
+/**
+ * struct usage_t - CPU usage sampler task struct
+ * @task            FreeRTOS task handle
+ * @tcb             FreeRTOS task tcb
+ * @stack           stack area used by the task
+ */
+typedef struct usage_t usage_t;
+
+struct usage_t {
+    TaskHandle_t task;
+    StaticTask_t tcb;
+    StackType_t stack[USAGE_STACK_SIZE];
+};
+
+
+/**
+ * struct usage_entry_t - accounted task
+ * @task            FreeRTOS task handle
+ * @name            task name
+ * @stage           stage the task is accounted to (USAGE_STAGE_*)
+ * @core            core the task is pinned to
+ * @last            run time counter at the previous sample in us
+ * @busy            run time since the first sample in us
+ */
+typedef struct usage_entry_t usage_entry_t;
+
+struct usage_entry_t {
+    TaskHandle_t task;
+    const char* name;
+    int stage;
+    int core;
+    uint32_t last;
+    unsigned long long busy;
+};
+
+
+/**
+ * usage_init() - start accounting CPU time to stages and tasks
+ * @u       sampler task struct
+ *
+ * Must be called once every other task has been created. Busy time of
+ * tasks comes from the FreeRTOS run time stats, that of the ISR from its
+ * enter and exit stamps. FreeRTOS accounts the time of an ISR to the
+ * task it interrupted, so the ISR time is also part of the busy time of
+ * the tasks of NIC_ISR_CORE.
+ */
+void usage_init(usage_t* u);
+
+/**
+ * usage_print_stats() - print the usage timeline and totals to serial
+ *
+ * Prints one line per period with the share of a core every task and
+ * the ISR took in permille, then the busy time per task and stage.
+ */
+void usage_print_stats(void);
+
+
+#endif
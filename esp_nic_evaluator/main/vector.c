@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#else
+#include "gpio_shim.h"
+#endif
+
+#include "vector.h"
+
+
+/**
+ * Pin pairs of the vectors and the current level of their output lines.
+ */
+static const int vector_pins[VECTOR_MAX][2] = VECTOR_PIN_TABLE;
+static uint32_t vector_level[VECTOR_MAX];
+
+
+void
+vector_init
+(vector_handler_t handler)
+{
+    gpio_install_isr_service(ESP_INTR_FLAG_EDGE);
+
+    for (int v = 0; v < VECTOR_COUNT; v++) {
+        int out = vector_pins[v][0];
+        int in = vector_pins[v][1];
+        gpio_config_t cfg = {
+            .mode = out == in ? GPIO_MODE_INPUT_OUTPUT : GPIO_MODE_INPUT,
+            .intr_type = GPIO_INTR_ANYEDGE,
+            .pin_bit_mask = 1ULL << in,
+            .pull_up_en = 1,
+        };
+
+        gpio_config(&cfg);
+
+        /* A separate output line is wired to the input. */
+        if (out != in) {
+            gpio_config_t out_cfg = {
+                .mode = GPIO_MODE_OUTPUT,
+                .intr_type = GPIO_INTR_DISABLE,
+                .pin_bit_mask = 1ULL << out,
+            };
+
+            gpio_config(&out_cfg);
+#ifndef ESP_PLATFORM
+            gpio_shim_connect(out, in);
+#endif
+        }
+
+        vector_level[v] = 0;
+        gpio_set_intr_type(in, GPIO_INTR_ANYEDGE);
+        gpio_isr_handler_add(in, handler, (void*)(intptr_t)v);
+    }
+}
+
+void IRAM_ATTR
+vector_raise
+(int vector)
+{
+    vector_level[vector] = !vector_level[vector];
+    gpio_set_level(vector_pins[vector][0], vector_level[vector]);
+}
+
+int IRAM_ATTR
+vector_of_queue
+(int queue)
+{
+    return queue % VECTOR_COUNT;
+}
+
+int IRAM_ATTR
+vector_queue
+(int vector, int nth)
+{
+    int queue = vector + nth * VECTOR_COUNT;
+
+    return queue < NIC_QUEUE_COUNT ? queue : -1;
+}
+
+int
+vector_pin
+(int vector)
+{
+    return vector_pins[vector][1];
+}
@@ -0,0 +1,63 @@
+#ifndef __VECTOR__
+#define __VECTOR__
+
+#include "nic_config.h"
+
+
+/*
+ * Interrupt vectors, one GPIO line per NIC queue like MSI-X. Per vector:
+ * { traffic output pin, net input pin }. Vector 0 keeps the wired pin
+ * pair, vectors with equal pins loop back inside the chip and need no
+ * wire. Queues beyond VECTOR_MAX share vectors round robin.
+ */
+#define VECTOR_MAX          4
+#define VECTOR_PIN_TABLE {              \
+    { 18, 4 },                          \
+    { 19, 19 },                         \
+    { 21, 21 },                         \
+    { 22, 22 },                         \
+}
+#define VECTOR_COUNT                    \
+    (NIC_QUEUE_COUNT < VECTOR_MAX ? NIC_QUEUE_COUNT : VECTOR_MAX)
+
+
+/**
+ * vector_handler_t - interrupt handler of a vector
+ * @vector      number of the vector, passed as pointer
+ */
+typedef void (*vector_handler_t)(void* vector);
+
+/**
+ * vector_init() - configure the vector lines and install their ISRs
+ * @handler     ISR added to every vector
+ *
+ * The GPIO interrupt is allocated on the calling core.
+ */
+void vector_init(vector_handler_t handler);
+
+/**
+ * vector_raise() - signal an interrupt on a vector
+ *
+ * Toggles the output line of the vector, both edges trigger the ISR.
+ */
+void vector_raise(int vector);
+
+/**
+ * vector_of_queue() - vector a NIC queue interrupts on
+ */
+int vector_of_queue(int queue);
+
+/**
+ * vector_queue() - NIC queue `nth` of the queues interrupting on a vector
+ *
+ * The inverse of vector_of_queue(), -1 once the vector has no more queues.
+ */
+int vector_queue(int vector, int nth);
+
+/**
+ * vector_pin() - input pin of a vector
+ */
+int vector_pin(int vector);
+
+
+#endif
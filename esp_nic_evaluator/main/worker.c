@@ -10,19 +10,58 @@
 #include "worker.h"
 #include "traffic.h"
 #include "net_api.h"
+#include "export.h"
+#include "workload.h"
+#include "clock.h"
+#include "deadline.h"
 
 
 static const char* TAG = "WRK";
 
-extern unsigned int obs_cycles;
-extern result_t *results;
-extern obs_t *obs_times;
-extern TaskHandle_t xObs;
 /**
  * Track worker count.
  */
 int worker_count = 0;
 
+/**
+ * Receive latency per driver path, used to compare the early demux path
+ * of pass-through queues with the path through the net task.
+ */
+static unsigned int path_packets[NET_PATH_COUNT];
+static unsigned long long path_latency[NET_PATH_COUNT];
+static unsigned int path_latency_max[NET_PATH_COUNT];
+static portMUX_TYPE path_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Receive latency per worker priority, to see how well the order in which
+ * packets are processed follows the priority of the waiting workers.
+ */
+static unsigned int prio_packets[configMAX_PRIORITIES];
+static unsigned long long prio_latency[configMAX_PRIORITIES];
+static unsigned int prio_latency_max[configMAX_PRIORITIES];
+
+/**
+ * Throughput and receive latency per core the packet was processed on.
+ */
+static unsigned int core_packets[portNUM_PROCESSORS];
+static unsigned long long core_latency[portNUM_PROCESSORS];
+static unsigned int core_latency_max[portNUM_PROCESSORS];
+static unsigned long long core_busy[portNUM_PROCESSORS];
+static long core_first[portNUM_PROCESSORS];
+static long core_last[portNUM_PROCESSORS];
+
+/**
+ * Home sockets of all pool workers, with the core of their owner, and the
+ * pool workers in the order they started.
+ */
+static int pool_sock[NIC_POOL_COUNT * WORKER_POLL_MAX];
+static int pool_core[NIC_POOL_COUNT * WORKER_POLL_MAX];
+static worker_t* pool_owner[NIC_POOL_COUNT * WORKER_POLL_MAX];
+static volatile int pool_sock_count;
+static worker_t* pool_worker[NIC_POOL_COUNT];
+static int pool_worker_count;
+static portMUX_TYPE pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
 /**
  * worker_main() - processes work packages received via network port
  * @port    port to receive work data on
@@ -31,11 +70,64 @@ int worker_count = 0;
  * to the amount of data that is received through the given port.
  */
 static void worker_main(void* port);
-static void observed_main(void* obs);
+
+/**
+ * worker_poll_main() - processes work packages of many ports in one task
+ * @wrk     worker struct carrying the ports to serve
+ *
+ * Binds one socket per port and waits on all of them with net_poll().
+ */
+static void worker_poll_main(worker_t* wrk);
+
+/**
+ * worker_pool_main() - processes work packages of the whole pool
+ * @wrk     worker struct carrying the home ports
+ *
+ * Drains the home ports first and kicks an idle worker if a home port
+ * still has a backlog. Without packets of its own the worker steals from
+ * the other ports and only then waits on its home ports, until it is
+ * kicked or the backoff expires.
+ */
+static void worker_pool_main(worker_t* wrk);
+
+/**
+ * worker_bind() - acquire and bind one socket per port of a worker
+ * @wrk     worker struct carrying the ports
+ * @fds     poll entries to fill, WORKER_POLL_MAX at most
+ *
+ * Returns the number of bound sockets.
+ */
+static int worker_bind(worker_t* wrk, net_pollfd_t* fds);
+
+/**
+ * worker_steal() - take packets from the most backed up foreign port
+ * @wrk     pool worker that steals
+ * @packets array to store at most WORKER_BATCH packets in
+ *
+ * Ports at home on the core of `wrk` are looked at first. Half of the
+ * backlog is left to the owner. Returns the number of stolen packets.
+ */
+static int worker_steal(worker_t* wrk, trace_packet_t** packets);
+
+/**
+ * worker_kick() - wake up an idle pool worker to steal
+ * @wrk     pool worker with a backlog
+ *
+ * Every idle worker is kicked at most once per wait.
+ */
+static void worker_kick(worker_t* wrk);
+
+/**
+ * worker_process() - measures and processes a single received packet
+ * @packet  packet buffer, handed back to the driver when done
+ * @wakeup  clock stamp when the worker woke up for the batch of `packet`
+ */
+static void worker_process(trace_packet_t* packet, uint32_t wakeup);
 
 void
 worker_init
-(const char* worker_name, worker_t* wrk, int id, unsigned short port, int prio)
+(const char* worker_name, worker_t* wrk, int id, unsigned short port,
+                                                        int prio, int core)
 {
     int i_port = (int)port;
     task_worker[id] = &wrk->task;
@@ -45,64 +137,121 @@ worker_init
         worker_name,
         WORKER_STACK_SIZE,
         (void*)i_port,
-        // WORKER_TASK_PRIORITY,
         prio,
         wrk->stack,
         &wrk->tcb,
-        WORKER_CORE
+        core
     );
 
     worker_count++;
 }
 
 void
-obs_init
-(int prio, worker_t* wrk)
+worker_init_poll
+(const char* worker_name, worker_t* wrk, int id,
+            const unsigned short* ports, int port_count, int prio, int core)
 {
-  // StackType_t stack[WORKER_STACK_SIZE];
-  xObs = xTaskCreateStaticPinnedToCore(
-      (TaskFunction_t)observed_main,
-      "observed",
-      WORKER_STACK_SIZE,
-      (void*) 1,
-      // WORKER_TASK_PRIORITY,
-      prio,
-      wrk->stack,
-      &wrk->tcb,
-      WORKER_CORE
-  );
+    task_worker[id] = &wrk->task;
+    wrk->ports = ports;
+    wrk->port_count = port_count;
+
+    wrk->task = xTaskCreateStaticPinnedToCore(
+        (TaskFunction_t)worker_poll_main,
+        worker_name,
+        WORKER_STACK_SIZE,
+        wrk,
+        prio,
+        wrk->stack,
+        &wrk->tcb,
+        core
+    );
+
+    worker_count++;
 }
 
-static unsigned int
-binom
-(unsigned int n, unsigned int k)
+void
+worker_init_pool
+(const char* worker_name, worker_t* wrk, int id,
+            const unsigned short* ports, int port_count, int prio, int core)
 {
-    if (2 * k > n) {
-        k = n - k;
-    }
-
-    unsigned int result = 1;
+    task_worker[id] = &wrk->task;
+    wrk->ports = ports;
+    wrk->port_count = port_count;
 
-    for (int i = 1; i <= k; i++) {
-        result *= (n - k + i) / i;
-    }
+    wrk->task = xTaskCreateStaticPinnedToCore(
+        (TaskFunction_t)worker_pool_main,
+        worker_name,
+        WORKER_STACK_SIZE,
+        wrk,
+        prio,
+        wrk->stack,
+        &wrk->tcb,
+        core
+    );
 
-    return result;
+    worker_count++;
 }
 
-void
-load
-()
+static void
+worker_process
+(trace_packet_t* packet, uint32_t wakeup)
 {
-    for (unsigned int i = 0; i <= 250; i++) {
-        for (
-            unsigned int j = 0;
-            (i == 250 && j <= 150) || j <= i;
-            j++
-        ) {
-            binom(i, j);
-        }
-    }
+    /* Meassure time the packet took to get here. */
+    uint32_t recv = clock_now();
+
+    /* The deadline of the worker is that of its current packet now. */
+    deadline_run(packet->port, packet->sent);
+
+    /* Save that time to the results. */
+    result_t result = {
+        .seq = packet->seq,
+        .port = packet->port,
+        .sent = packet->sent,
+        .isr = packet->isr,
+        .dequeue = packet->dequeue,
+        .wakeup = wakeup,
+        .received = recv,
+    };
+
+    /* Account the latency to the path taken and the worker priority. */
+    unsigned int latency = clock_us(recv - packet->sent);
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    portENTER_CRITICAL(&path_mux);
+    path_packets[packet->path]++;
+    path_latency[packet->path] += latency;
+    if (latency > path_latency_max[packet->path])
+        path_latency_max[packet->path] = latency;
+    prio_packets[prio]++;
+    prio_latency[prio] += latency;
+    if (latency > prio_latency_max[prio])
+        prio_latency_max[prio] = latency;
+    portEXIT_CRITICAL(&path_mux);
+
+    /* Measure runtime over constant CPU time per packet. */
+    uint32_t start_time = clock_now();
+    /* Busy wait as long as the workload of the port asks for. */
+    workload_run(packet->port, packet->seq);
+    result.runtime = clock_now() - start_time;
+
+    /* Account throughput and latency to the core the worker runs on. */
+    int core = xPortGetCoreID();
+    long now = esp_timer_get_time();
+    portENTER_CRITICAL(&path_mux);
+    if (!core_packets[core])
+        core_first[core] = now;
+    core_last[core] = now;
+    core_packets[core]++;
+    core_latency[core] += latency;
+    if (latency > core_latency_max[core])
+        core_latency_max[core] = latency;
+    core_busy[core] += clock_us(result.runtime);
+    portEXIT_CRITICAL(&path_mux);
+
+    deadline_done(packet->port, packet->sent);
+
+    /* Hand the packet buffer back to the driver and stream the result. */
+    net_free(packet);
+    export_push(&result);
 }
 
 static void
@@ -110,81 +259,296 @@ worker_main
 (void* port)
 {
     int sock;
-    unsigned int rando = 0;
-    unsigned char buf[BUFFER_SIZE];
+    trace_packet_t* packets[WORKER_BATCH];
 
     ESP_LOGI(TAG, "Start worker in port=%d.", (int)port);
     ets_printf("Worker registered to core %d\n", xPortGetCoreID());
 
-    /* Aquire socket from system. */
-    if ((sock = net_sock()) <= 0) {
-        ESP_LOGD(TAG, "Aquiring sock failed (%d).", sock);
+    /* Aquire socket from system and bind it to the port. */
+    if ((sock = net_sock()) <= 0 || net_bind(sock, (int)port) < 0) {
+        ESP_LOGE(TAG, "Bind on port=%d failed (%d), worker stops.",
+            (int)port, sock);
+        vTaskSuspend(NULL);
     }
 
-    /* Bind socket to port. */
-    if ((net_bind(sock, (int)port)) < 0) {
-        ESP_LOGD(TAG, "Port bind failed.");
+    /* Main worker loop */
+    while (true) {
+        /* Receive everything the 'network' queued for us in one wakeup. */
+        int count = net_recvmmsg(sock, (void**)packets, WORKER_BATCH, 0);
+
+        /* Out of packets, give up the deadline before blocking. */
+        if (count <= 0) {
+            deadline_idle((int)port);
+            count = net_recvmmsg(
+                sock, (void**)packets, WORKER_BATCH, portMAX_DELAY
+            );
+        }
+        uint32_t wakeup = clock_now();
+
+        for (int i = 0; i < count; i++) {
+            worker_process(packets[i], wakeup);
+        }
     }
+}
+
+static void
+worker_poll_main
+(worker_t* wrk)
+{
+    net_pollfd_t fds[WORKER_POLL_MAX];
+    trace_packet_t* packets[WORKER_BATCH];
+    int nfds;
+
+    ets_printf("Poll worker registered to core %d\n", xPortGetCoreID());
+
+    nfds = worker_bind(wrk, fds);
 
     /* Main worker loop */
     while (true) {
-        /* Receive data from the 'network'. */
-        net_recv(sock, buf, BUFFER_SIZE);
-
-        /* Meassure time the packet took to get here. */
-        long recv = esp_timer_get_time();
-
-        /* Save that time to the results. */
-        unsigned int seq = ((trace_packet_t*)buf)->seq;
-
-        // ESP_LOGI(
-        //     TAG, "rx=%ld, d=%hu, p=%u, c=%u (%d)",
-        //     recv, ((trace_packet_t*)buf)->delta, ((trace_packet_t*)buf)->port, ((trace_packet_t*)buf)->count, ((trace_packet_t*)buf)->seq
-        // );
-
-        results[seq].received = recv;
-
-        // /* Generate one random byte. */
-        // rando = 0;
-        // esp_fill_random(&rando, 1);
-        //
-        // /* Cut range. */
-        // rando >>= WORKER_RAND_SHIFT;
-        //
-        // /* Scale. */
-        // rando *= WORKER_RAND_BASE_US;
-        //
-        // /* Ensure minimum wait. */
-        // rando += WORKER_RAND_MIN;
-        //
-        // ESP_LOGI(TAG, "seq=%d, recv=%ld, rando=%d", seq, recv, rando);
-
-        /* Measure runtime over constant CPU time per packet. */
-        long start_time = esp_timer_get_time();
-        /* Busy wait. */
-        load();
-        unsigned int runtime = esp_timer_get_time() - start_time;
-        results[seq].runtime = runtime;
+        if (net_poll(fds, nfds, portMAX_DELAY) <= 0)
+            continue;
+        uint32_t wakeup = clock_now();
+
+        /* Drain every socket that became ready. */
+        for (int i = 0; i < nfds; i++) {
+            if (!(fds[i].revents & NET_POLLIN))
+                continue;
+
+            int count = net_recvmmsg(
+                fds[i].sock, (void**)packets, WORKER_BATCH, 0
+            );
+            for (int k = 0; k < count; k++) {
+                worker_process(packets[k], wakeup);
+            }
+        }
+    }
+}
+
+static int
+worker_bind
+(worker_t* wrk, net_pollfd_t* fds)
+{
+    int nfds = 0;
+
+    if (wrk->port_count > WORKER_POLL_MAX) {
+        ESP_LOGE(TAG, "Only %d of %d ports are served.", WORKER_POLL_MAX,
+            wrk->port_count);
+    }
+
+    /* Aquire and bind one socket per port. */
+    for (int i = 0; i < wrk->port_count && nfds < WORKER_POLL_MAX; i++) {
+        int sock = net_sock();
+
+        if (sock <= 0 || net_bind(sock, wrk->ports[i]) < 0) {
+            ESP_LOGE(TAG, "Bind on port=%u failed.", wrk->ports[i]);
+            continue;
+        }
+        fds[nfds].sock = sock;
+        fds[nfds].revents = 0;
+        nfds++;
+    }
+
+    return nfds;
+}
+
+static void
+worker_pool_main
+(worker_t* wrk)
+{
+    net_pollfd_t fds[WORKER_POLL_MAX];
+    trace_packet_t* packets[WORKER_BATCH];
+    int core = xPortGetCoreID();
+    int nfds;
+
+    ets_printf("Pool worker registered to core %d\n", core);
+
+    nfds = worker_bind(wrk, fds);
+
+    /* Let the other pool workers find the home sockets. */
+    portENTER_CRITICAL(&pool_mux);
+    for (int i = 0; i < nfds; i++) {
+        pool_sock[pool_sock_count] = fds[i].sock;
+        pool_core[pool_sock_count] = core;
+        pool_owner[pool_sock_count] = wrk;
+        pool_sock_count++;
+    }
+    if (pool_worker_count < NIC_POOL_COUNT)
+        pool_worker[pool_worker_count++] = wrk;
+    portEXIT_CRITICAL(&pool_mux);
+
+    TickType_t backoff = WORKER_STEAL_TICKS_MIN;
+
+    /* Main worker loop */
+    while (true) {
+        int home = 0;
+
+        /* One batch of every home port, so none starves another. */
+        for (int i = 0; i < nfds; i++) {
+            int count = net_recvmmsg(
+                fds[i].sock, (void**)packets, WORKER_BATCH, 0
+            );
+            uint32_t wakeup = clock_now();
+
+            for (int k = 0; k < count; k++) {
+                worker_process(packets[k], wakeup);
+            }
+            if (count > 0)
+                home += count;
+            if (net_backlog(fds[i].sock) >= NIC_POOL_STEAL_MIN)
+                worker_kick(wrk);
+        }
+        wrk->home_packets += home;
+        if (home)
+            continue;
+
+        int stolen = worker_steal(wrk, packets);
+        uint32_t wakeup = clock_now();
+
+        for (int k = 0; k < stolen; k++) {
+            worker_process(packets[k], wakeup);
+        }
+        if (stolen) {
+            wrk->stolen_packets += stolen;
+            wrk->steals++;
+            backoff = WORKER_STEAL_TICKS_MIN;
+            continue;
+        }
+
+        /* Nothing anywhere, wait for home packets, a kick or the backoff. */
+        int kicked;
+
+        portENTER_CRITICAL(&pool_mux);
+        wrk->idle = 1;
+        portEXIT_CRITICAL(&pool_mux);
+
+        int ready = net_poll(fds, nfds, backoff);
+
+        portENTER_CRITICAL(&pool_mux);
+        kicked = !wrk->idle;
+        wrk->idle = 0;
+        portEXIT_CRITICAL(&pool_mux);
+
+        if (kicked) {
+            wrk->kicks++;
+            backoff = WORKER_STEAL_TICKS_MIN;
+        } else if (ready == 0 && backoff < WORKER_STEAL_TICKS_MAX) {
+            backoff *= 2;
+        }
     }
 }
 
+static int
+worker_steal
+(worker_t* wrk, trace_packet_t** packets)
+{
+    int core = xPortGetCoreID();
+    int count = pool_sock_count;
+    int victim = -1;
+    int backlog = 0;
+
+    for (int local = 1; local >= 0 && victim < 0; local--) {
+        for (int i = 0; i < count; i++) {
+            int queued;
+
+            if (pool_owner[i] == wrk || (pool_core[i] == core) != local)
+                continue;
+            queued = net_backlog(pool_sock[i]);
+            if (queued >= NIC_POOL_STEAL_MIN && queued > backlog) {
+                victim = i;
+                backlog = queued;
+            }
+        }
+    }
+
+    if (victim < 0)
+        return 0;
+
+    /* Leave the owner its share, it is on the way or busy with a batch. */
+    backlog = (backlog + 1) / 2;
+    if (backlog > WORKER_BATCH)
+        backlog = WORKER_BATCH;
+
+    return net_steal(pool_sock[victim], (void**)packets, backlog);
+}
+
 static void
-observed_main
-(void* obs)
+worker_kick
+(worker_t* wrk)
 {
-    ets_printf("Observed task registered to core %d\n", xPortGetCoreID());
-    int cnt = 0;
-    vTaskSuspend(NULL);
-    while(true){
-        vTaskDelay(50/ portTICK_PERIOD_MS);
-        long start_time = esp_timer_get_time();
-        load();
-        if(cnt == 0){
-          unsigned int runtime = esp_timer_get_time() - start_time;
-          obs_times[obs_cycles].runtime = runtime;
-          obs_cycles++;
-          cnt = 0;
+    worker_t* idle = NULL;
+
+    portENTER_CRITICAL(&pool_mux);
+    for (int i = 0; i < pool_worker_count; i++) {
+        if (pool_worker[i] != wrk && pool_worker[i]->idle) {
+            idle = pool_worker[i];
+            idle->idle = 0;
+            break;
         }
-        //cnt++;
+    }
+    portEXIT_CRITICAL(&pool_mux);
+
+    if (idle != NULL)
+        net_poll_kick(idle->task);
+}
+
+void
+worker_print_stats
+(void)
+{
+    static const char* path_names[NET_PATH_COUNT] = { "normal", "early" };
+    unsigned int mean[NET_PATH_COUNT] = {0};
+
+    for (int i = 0; i < NET_PATH_COUNT; i++) {
+        if (path_packets[i])
+            mean[i] = path_latency[i] / path_packets[i];
+        ets_printf(
+            "# path=%s packets=%u mean_us=%u max_us=%u\n",
+            path_names[i], path_packets[i], mean[i], path_latency_max[i]
+        );
+    }
+
+    for (int i = configMAX_PRIORITIES - 1; i >= 0; i--) {
+        if (!prio_packets[i])
+            continue;
+        ets_printf(
+            "# prio=%d packets=%u mean_us=%u max_us=%u\n",
+            i, prio_packets[i],
+            (unsigned int)(prio_latency[i] / prio_packets[i]),
+            prio_latency_max[i]
+        );
+    }
+
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        unsigned long long span = core_last[i] - core_first[i];
+
+        if (!core_packets[i])
+            continue;
+        ets_printf(
+            "# core=%d packets=%u mean_us=%u max_us=%u busy_us=%llu "
+            "span_us=%llu pps=%u\n",
+            i, core_packets[i],
+            (unsigned int)(core_latency[i] / core_packets[i]),
+            core_latency_max[i], core_busy[i], span,
+            span ? (unsigned int)(core_packets[i] * 1000000ULL / span) : 0
+        );
+    }
+
+    for (int i = 0; i < pool_worker_count; i++) {
+        worker_t* wrk = pool_worker[i];
+
+        ets_printf(
+            "# pool worker=%s core=%d home_packets=%u stolen_packets=%u "
+            "steals=%u kicks=%u\n",
+            pcTaskGetTaskName(wrk->task), xTaskGetAffinity(wrk->task),
+            wrk->home_packets, wrk->stolen_packets, wrk->steals, wrk->kicks
+        );
+    }
+
+    /* Only meaningful if both paths carried comparable traffic. */
+    if (path_packets[NET_PATH_NORMAL] && path_packets[NET_PATH_EARLY]) {
+        ets_printf(
+            "# path early_saved_us=%d\n",
+            (int)mean[NET_PATH_NORMAL] - (int)mean[NET_PATH_EARLY]
+        );
     }
 }
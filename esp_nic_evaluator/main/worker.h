@@ -4,16 +4,28 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-#define WORKER_CORE             0
-#define WORKER_COUNT            4
+#include "nic_config.h"
+
+#define WORKER_COUNT                                                    \
+    (NIC_POOL_COUNT > NIC_WORKER_COUNT ? NIC_POOL_COUNT : NIC_WORKER_COUNT)
 #define WORKER_STACK_SIZE       0x1000
-#define WORKER_TASK_PRIORITY    10
-#define BUFFER_SIZE             512
+#define WORKER_BATCH            32
+/*
+ * Sockets one task can wait on, NET_SOCK_MAX - 1: every socket has its own
+ * bit of the 32 bit task notification value and socket 0 is never handed
+ * out.
+ */
+#define WORKER_POLL_MAX         31
 
-#define WORKER_RAND_MIN         10
-#define WORKER_RAND_SHIFT       4
-#define WORKER_RAND_BASE_US     10
-#define BUSYTIME                5000
+/*
+ * The owner of a port is only notified of its own packets. An idle pool
+ * worker sleeps until an owner with a backlog kicks it, or looks for
+ * packets to steal after a backoff. The backoff doubles from
+ * WORKER_STEAL_TICKS_MIN up to WORKER_STEAL_TICKS_MAX while there are
+ * none.
+ */
+#define WORKER_STEAL_TICKS_MIN  1
+#define WORKER_STEAL_TICKS_MAX  64
 
 /**
  * worker_t - worker task struct
@@ -21,29 +33,118 @@
  * @task            FreeRTOS task handle
  * @tcb             FreeRTOS task tcb
  * @stack           stack area used by the task
+ * @ports           ports served by a polling worker, home ports of a pool
+ *                  worker
+ * @port_count      number of entries in `ports`
+ * @home_packets    packets a pool worker took from its home ports
+ * @stolen_packets  packets a pool worker stole from other ports
+ * @steals          number of batches a pool worker stole
+ * @idle            a pool worker waits for packets and may be kicked
+ * @kicks           number of times a pool worker was kicked to steal
  */
 typedef struct {
     TaskHandle_t task;
     StaticTask_t tcb;
     StackType_t stack[WORKER_STACK_SIZE];
+    const unsigned short* ports;
+    int port_count;
+    unsigned int home_packets;
+    unsigned int stolen_packets;
+    unsigned int steals;
+    int idle;
+    unsigned int kicks;
 } worker_t;
 
 
+/**
+ * Worker placement, one entry of NIC_WORKER_TABLE.
+ *
+ * @name        name of the worker task
+ * @port        port to receive work from
+ * @priority    priority of the worker task
+ * @core        core the worker task is pinned to
+ * @deadline_us relative deadline of the packets of the port, 0 for none
+ */
+typedef struct {
+    const char* name;
+    unsigned short port;
+    int priority;
+    int core;
+    unsigned int deadline_us;
+} worker_cfg_t;
+
+
+/**
+ * Placement of a worker serving many ports, one entry of NIC_POLL_TABLE
+ * or NIC_POOL_TABLE.
+ *
+ * @name        name of the worker task
+ * @priority    priority of the worker task
+ * @core        core the worker task is pinned to
+ */
+typedef struct {
+    const char* name;
+    int priority;
+    int core;
+} pool_cfg_t;
+
+
 /**
  * worker_init() - Initializes and starts a worker thread.
  *
- * @worker_name     port to receive work from
+ * @worker_name     name of the worker task
  * @worker          worker configuration struct
  * @id              identifier of the worker, used to mask to tasks.h handles
  * @port            port to receive work from
  * @prio            priority of worker task
+ * @core            core the worker task is pinned to
  *
- * TODO: Clean up the messy interface.
+ * The worker serves a single port, see worker_init_poll() for many.
  */
 void worker_init(const char* worker_name, worker_t* worker,
-                                        int id, unsigned short port, int prio);
+                            int id, unsigned short port, int prio, int core);
+
+/**
+ * worker_init_poll() - Initializes and starts a worker serving many ports.
+ *
+ * @worker_name     name of the worker task
+ * @worker          worker configuration struct
+ * @id              identifier of the worker, used to mask to tasks.h handles
+ * @ports           ports to receive work from, must outlive the worker
+ * @port_count      number of ports, at most WORKER_POLL_MAX are served
+ * @prio            priority of worker task
+ * @core            core the worker task is pinned to
+ *
+ * A single task waits on all ports with net_poll(), which suits many
+ * low-rate ports better than one task per port.
+ */
+void worker_init_poll(const char* worker_name, worker_t* worker, int id,
+            const unsigned short* ports, int port_count, int prio, int core);
 
-void obs_init(int prio, worker_t* worker);
+/**
+ * worker_init_pool() - Initializes and starts a worker of the shared pool.
+ *
+ * @worker_name     name of the worker task
+ * @worker          worker configuration struct
+ * @id              identifier of the worker, used to mask to tasks.h handles
+ * @ports           home ports of the worker, must outlive the worker
+ * @port_count      number of ports, at most WORKER_POLL_MAX are served
+ * @prio            priority of worker task
+ * @core            core the worker task is pinned to
+ *
+ * Like a polling worker, but once its home ports are empty it steals
+ * packets from the ports of the other pool workers.
+ */
+void worker_init_pool(const char* worker_name, worker_t* worker, int id,
+            const unsigned short* ports, int port_count, int prio, int core);
+
+/**
+ * worker_print_stats() - print receive latency per driver path to serial
+ *
+ * Also prints throughput and latency per core, to compare task placements,
+ * and the packets of own and stolen ports per pool worker.
+ */
+void worker_print_stats(void);
 
 
 #endif
@@ -0,0 +1,281 @@
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "workload.h"
+#include "clock.h"
+#include "nic_config.h"
+
+
+/**
+ * Results of every kernel end up here. Stores to a volatile object may not
+ * be removed, so neither may the work computing them.
+ */
+volatile uint32_t workload_sink;
+
+/**
+ * Port models and the cost distributions of table-driven ports.
+ */
+static const workload_cfg_t workload_cfg[NIC_WORKLOAD_COUNT + 1] =
+    NIC_WORKLOAD_TABLE;
+static const workload_dist_t workload_dist[NIC_WORKLOAD_DIST_COUNT + 1] =
+    NIC_WORKLOAD_DIST_TABLE;
+
+/**
+ * Calibrated cycles per kernel iteration in 1/WORKLOAD_CPI_SCALE, and
+ * the cycles one original binomial load took.
+ */
+static uint32_t workload_compute_cpi;
+static uint32_t workload_memory_cpi;
+static uint32_t workload_binom_cycles;
+
+/**
+ * Words walked by the memory-bound kernel, each holding the index of the
+ * next one.
+ */
+static uint32_t workload_words[WORKLOAD_MEMORY_WORDS];
+
+/**
+ * workload_compute() - arithmetic kernel, `iters` dependent mix steps
+ */
+static uint32_t workload_compute(uint32_t iters, uint32_t x);
+
+/**
+ * workload_memory() - memory-bound kernel, `iters` dependent loads
+ */
+static uint32_t workload_memory(uint32_t iters, uint32_t at);
+
+/**
+ * workload_calibrate() - cycles per iteration of a kernel
+ * @memory  calibrate the memory-bound kernel instead of the arithmetic one
+ *
+ * Returns the cycles in 1/WORKLOAD_CPI_SCALE, at least 1.
+ */
+static uint32_t workload_calibrate(int memory);
+
+/**
+ * workload_find() - workload of `port`, NULL if it keeps the default
+ */
+static const workload_cfg_t* workload_find(unsigned short port);
+
+/**
+ * workload_draw() - cost of a packet of a table-driven port
+ */
+static uint32_t workload_draw(const workload_cfg_t* w, unsigned int seq);
+
+
+void
+workload_init
+(void)
+{
+    uint32_t start;
+
+    for (int i = 0; i < WORKLOAD_MEMORY_WORDS; i++)
+        workload_words[i] = (i + WORKLOAD_MEMORY_STRIDE) &
+            (WORKLOAD_MEMORY_WORDS - 1);
+
+    workload_compute_cpi = workload_calibrate(0);
+    workload_memory_cpi = workload_calibrate(1);
+
+    start = clock_now();
+    workload_sink = workload_binom();
+    workload_binom_cycles = clock_now() - start;
+}
+
+uint32_t
+workload_run
+(unsigned short port, unsigned int seq)
+{
+    const workload_cfg_t* w = workload_find(port);
+    int model = w ? w->model : WORKLOAD_DEFAULT;
+    uint32_t cycles = 0;
+
+    switch (model) {
+    case WORKLOAD_FIXED:
+        cycles = w->cycles;
+        workload_spin(cycles, seq);
+        break;
+    case WORKLOAD_TABLE:
+        cycles = workload_draw(w, seq);
+        workload_spin(cycles, seq);
+        break;
+    case WORKLOAD_MEMORY:
+        cycles = w->cycles;
+        workload_sink = workload_memory(
+            (uint64_t)cycles * WORKLOAD_CPI_SCALE / workload_memory_cpi,
+            seq & (WORKLOAD_MEMORY_WORDS - 1)
+        );
+        break;
+    default:
+        workload_sink = workload_binom();
+        break;
+    }
+
+    return cycles;
+}
+
+void
+workload_spin
+(uint32_t cycles, uint32_t seed)
+{
+    workload_sink = workload_compute(
+        (uint64_t)cycles * WORKLOAD_CPI_SCALE / workload_compute_cpi, seed
+    );
+}
+
+static uint32_t
+binom
+(uint32_t n, uint32_t k)
+{
+    if (2 * k > n) {
+        k = n - k;
+    }
+
+    uint32_t result = 1;
+
+    for (int i = 1; i <= k; i++) {
+        result *= (n - k + i) / i;
+    }
+
+    return result;
+}
+
+uint32_t
+workload_binom
+(void)
+{
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i <= 250; i++) {
+        for (
+            uint32_t j = 0;
+            (i == 250 && j <= 150) || j <= i;
+            j++
+        ) {
+            sum += binom(i, j);
+        }
+    }
+
+    return sum;
+}
+
+static uint32_t
+workload_compute
+(uint32_t iters, uint32_t x)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        x = x * 1103515245 + 12345;
+        x ^= x >> 13;
+    }
+
+    return x;
+}
+
+static uint32_t
+workload_memory
+(uint32_t iters, uint32_t at)
+{
+    for (uint32_t i = 0; i < iters; i++)
+        at = workload_words[at];
+
+    return at;
+}
+
+static uint32_t
+workload_calibrate
+(int memory)
+{
+    uint32_t best = UINT32_MAX;
+
+    for (int run = 0; run < WORKLOAD_CALIB_RUNS; run++) {
+        uint32_t start = clock_now();
+
+        if (memory)
+            workload_sink = workload_memory(WORKLOAD_CALIB_ITERS, run);
+        else
+            workload_sink = workload_compute(WORKLOAD_CALIB_ITERS, run);
+
+        uint32_t cycles = clock_now() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+
+    best = (uint64_t)best * WORKLOAD_CPI_SCALE / WORKLOAD_CALIB_ITERS;
+
+    return best ? best : 1;
+}
+
+static const workload_cfg_t*
+workload_find
+(unsigned short port)
+{
+    for (int i = 0; i < NIC_WORKLOAD_COUNT; i++) {
+        if (workload_cfg[i].port == port)
+            return &workload_cfg[i];
+    }
+
+    return NULL;
+}
+
+static uint32_t
+workload_draw
+(const workload_cfg_t* w, unsigned int seq)
+{
+    const workload_dist_t* dist = &workload_dist[w->dist_first];
+    uint32_t total = 0;
+    uint32_t h = seq;
+
+    for (int i = 0; i < w->dist_count; i++)
+        total += dist[i].weight;
+    if (!total)
+        return 0;
+
+    /* Spread consecutive sequence numbers over the whole range. */
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    h %= total;
+    for (int i = 0; i < w->dist_count; i++) {
+        if (h < dist[i].weight)
+            return dist[i].cycles;
+        h -= dist[i].weight;
+    }
+
+    return 0;
+}
+
+void
+workload_print_stats
+(void)
+{
+    static const char* models[WORKLOAD_MODELS] = {
+        "binom", "fixed", "table", "memory"
+    };
+
+    ets_printf(
+        "# workload compute_cycles_per_k=%u memory_cycles_per_k=%u "
+        "binom_cycles=%u\n",
+        workload_compute_cpi * 1000 / WORKLOAD_CPI_SCALE,
+        workload_memory_cpi * 1000 / WORKLOAD_CPI_SCALE,
+        workload_binom_cycles
+    );
+
+    for (int i = 0; i < NIC_WORKLOAD_COUNT; i++) {
+        const workload_cfg_t* w = &workload_cfg[i];
+
+        ets_printf(
+            "# workload port=%u model=%s cycles=%u\n",
+            w->port, models[w->model], w->cycles
+        );
+        for (int d = 0; d < w->dist_count; d++) {
+            ets_printf(
+                "# workload port=%u dist_cycles=%u weight=%u\n",
+                w->port, workload_dist[w->dist_first + d].cycles,
+                workload_dist[w->dist_first + d].weight
+            );
+        }
+    }
+}
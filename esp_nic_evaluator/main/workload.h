@@ -0,0 +1,124 @@
+#ifndef __WORKLOAD__
+#define __WORKLOAD__
+
+#include <stdint.h>
+
+
+/*
+ * Workload models, the model column of NIC_WORKLOAD_TABLE.
+ *
+ * WORKLOAD_BINOM is the original binomial load, its cost depends on the
+ * compiler and the CPU clock. The other models cost a given number of CPU
+ * cycles, calibrated at boot: WORKLOAD_FIXED always the same, WORKLOAD_TABLE
+ * one drawn from the weighted rows of NIC_WORKLOAD_DIST_TABLE of the port
+ * and WORKLOAD_MEMORY the same, spent on dependent loads instead of
+ * arithmetic.
+ */
+#define WORKLOAD_BINOM          0
+#define WORKLOAD_FIXED          1
+#define WORKLOAD_TABLE          2
+#define WORKLOAD_MEMORY         3
+#define WORKLOAD_MODELS         4
+
+/*
+ * Ports without a row in NIC_WORKLOAD_TABLE keep the original load.
+ */
+#define WORKLOAD_DEFAULT        WORKLOAD_BINOM
+
+/*
+ * Calibration runs every kernel WORKLOAD_CALIB_RUNS times for
+ * WORKLOAD_CALIB_ITERS iterations and keeps the fastest run, the others
+ * were interrupted. Cycles per iteration are kept in 1/WORKLOAD_CPI_SCALE.
+ */
+#define WORKLOAD_CALIB_ITERS    4096
+#define WORKLOAD_CALIB_RUNS     8
+#define WORKLOAD_CPI_SCALE      256
+
+/*
+ * Words walked by the memory-bound kernel, a power of two. The walk
+ * visits them in a fixed stride order so that every load depends on the
+ * previous one.
+ */
+#define WORKLOAD_MEMORY_WORDS   0x800
+#define WORKLOAD_MEMORY_STRIDE  0x25b
+
+
+/*
+ * Every kernel result is stored here, so no kernel can be optimized away.
+ */
+extern volatile uint32_t workload_sink;
+
+
+/**
+ * struct workload_cfg_t - workload of a port, one entry of NIC_WORKLOAD_TABLE
+ * @port            network port
+ * @model           workload model (WORKLOAD_*)
+ * @cycles          cost per packet in CPU cycles, unused by WORKLOAD_TABLE
+ * @dist_first      first row of the port in NIC_WORKLOAD_DIST_TABLE
+ * @dist_count      number of rows of the port in NIC_WORKLOAD_DIST_TABLE
+ */
+typedef struct workload_cfg_t workload_cfg_t;
+
+struct workload_cfg_t {
+    unsigned short port;
+    int model;
+    uint32_t cycles;
+    int dist_first;
+    int dist_count;
+};
+
+/**
+ * struct workload_dist_t - one cost of a table-driven distribution
+ * @cycles          cost per packet in CPU cycles
+ * @weight          relative frequency of the cost
+ */
+typedef struct workload_dist_t workload_dist_t;
+
+struct workload_dist_t {
+    uint32_t cycles;
+    uint32_t weight;
+};
+
+
+/**
+ * workload_init() - calibrate the kernels against the cycle counter
+ *
+ * Must be called before the first workload_run(), while nothing else
+ * runs on the core.
+ */
+void workload_init(void);
+
+/**
+ * workload_run() - spend the CPU time a packet of `port` costs
+ * @port    port the packet was received on
+ * @seq     sequence number of the packet
+ *
+ * Costs of table-driven ports are drawn from a hash of `seq`, so every
+ * run of a trace draws the same costs. Returns the number of cycles the
+ * model asked for, 0 for WORKLOAD_BINOM.
+ */
+uint32_t workload_run(unsigned short port, unsigned int seq);
+
+/**
+ * workload_spin() - spend `cycles` CPU cycles on arithmetic
+ * @cycles  cost in CPU cycles
+ * @seed    start value of the kernel
+ *
+ * The kernel of WORKLOAD_FIXED, for other tasks than the workers.
+ */
+void workload_spin(uint32_t cycles, uint32_t seed);
+
+/**
+ * workload_binom() - the original load, binomial coefficients of 0..250
+ *
+ * Returns the sum of the coefficients, callers must keep it.
+ */
+uint32_t workload_binom(void);
+
+/**
+ * workload_print_stats() - print the calibration and the port models
+ */
+void workload_print_stats(void);
+
+
+#endif
@@ -15,6 +15,8 @@ for top, dirs, files in os.walk(root):
         os.system('rm ' + top + '/interrupt_trace.stats.csv > /dev/null')
         os.system('rm ' + top + '/sequence.csv > /dev/null')
         os.system('rm ' + top + '/trace.h > /dev/null')
+        os.system('rm ' + top + '/nic_config.h > /dev/null')
         os.system('rm ' + top + '/rx_times.csv > /dev/null')
+        os.system('rm ' + top + '/stats.txt > /dev/null')
         os.system('rm -r ' + top + '/figures > /dev/null')
         # os.system('rm ' + top + '/packet_trace.csv > /dev/null')
@@ -0,0 +1,134 @@
+'''
+Decoder for the binary result stream of the firmware (see frame.h). Frames are COBS encoded and terminated by a zero
+byte, so after a corrupted frame the decoder resyncs at the next zero byte. Text the firmware prints between frames,
+e.g. the '#' statistics and the final END, is passed through line by line.
+'''
+
+
+def crc16(data: bytes) -> int:
+    ''' CRC-16/CCITT, poly 0x1021, init 0xffff. '''
+    crc = 0xffff
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xffff
+    return crc
+
+
+def cobs_decode(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('broken COBS block')
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def read_varint(data: bytes, pos: int) -> (int, int):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data) or shift > 28:
+            raise ValueError('truncated varint')
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value: int) -> int:
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_frame(frame: bytes) -> list:
+    '''
+    Returns the (seq, sent, recv, tx_delay, runtime, drop, isr_ns, dequeue_ns, wakeup_ns, tx_delay_ns, runtime_ns) rows
+    of one frame, raises ValueError if corrupted. The us columns are derived from the ns ones like the firmware does.
+    '''
+    data = cobs_decode(frame)
+    if len(data) < 2:
+        raise ValueError('short frame')
+    payload, crc = data[:-2], data[-2] | data[-1] << 8
+    if crc16(payload) != crc:
+        raise ValueError('CRC mismatch')
+
+    rows = []
+    seq = sent = 0
+    pos = 0
+    while pos < len(payload):
+        delta, pos = read_varint(payload, pos)
+        seq = (seq + unzigzag(delta)) & 0xffffffff
+        delta, pos = read_varint(payload, pos)
+        sent = (sent + unzigzag(delta)) & 0xffffffff
+        drop, pos = read_varint(payload, pos)
+        stamps = [0] * 5
+        if not drop:
+            for i in range(5):
+                stamps[i], pos = read_varint(payload, pos)
+        isr_ns, dequeue_ns, wakeup_ns, tx_delay_ns, runtime_ns = stamps
+        recv = 0 if drop else (sent + tx_delay_ns // 1000) & 0xffffffff
+        # Same wrap around as the text format for packets never received.
+        rows.append((seq, sent, recv, (recv - sent) & 0xffffffff, runtime_ns // 1000, drop) + tuple(stamps))
+    return rows
+
+
+def format_row(row: tuple) -> str:
+    return ', '.join('%u' % value for value in row) + '\n'
+
+
+class ResultStream:
+    '''
+    Feed raw serial bytes with feed(). Decoded rows are collected in `rows`, text lines in `lines`. `done` is set once
+    the firmware printed END. Chunks that are neither a valid frame nor text are counted in `corrupted`.
+    '''
+
+    def __init__(self):
+        self.pending = bytearray()
+        self.rows = []
+        self.lines = []
+        self.corrupted = 0
+        self.done = False
+
+    def feed(self, data: bytes):
+        self.pending += data
+        while True:
+            end = self.pending.find(0)
+            if end < 0:
+                break
+            chunk = bytes(self.pending[:end])
+            del self.pending[:end + 1]
+            self._chunk(chunk)
+
+        # Text after the last frame is never terminated by a zero byte.
+        if b'END\n' in self.pending:
+            text, _, _ = bytes(self.pending).partition(b'END\n')
+            self._text(text)
+            self.pending.clear()
+            self.done = True
+
+    def _chunk(self, chunk: bytes):
+        # Text printed before a frame ends up in front of it, the frame starts after the last newline.
+        text, frame = b'', chunk
+        for start in [0] + [i + 1 for i, byte in enumerate(chunk) if byte == ord('\n')][::-1]:
+            try:
+                self.rows += decode_frame(chunk[start:])
+                text, frame = chunk[:start], None
+                break
+            except ValueError:
+                continue
+        if frame is not None:
+            self.corrupted += 1
+            return
+        self._text(text)
+
+    def _text(self, text: bytes):
+        for line in text.decode('utf-8', errors='replace').splitlines():
+            self.lines.append(line + '\n')
@@ -4,21 +4,45 @@ traces. with one folder per trace and experiment.
 '''
 
 from serial import Serial
+from result_stream import ResultStream, format_row
 import argparse
 import os
 import time
 
 
 standard_port = '/dev/ttyUSB0'
+# Must match CONFIG_ESP_CONSOLE_UART_BAUDRATE, streamed results need far more than 115200 baud.
+baud_rate = 921600
 standard_path = 'experiments/example_settings'
 interrupt_trace = 'interrupt_trace.csv'
 output_file = 'rx_times.csv'
+stats_file = 'stats.txt'
 project_path = 'esp_nic_evaluator'
 trace2blob_path = 'trace2blob/trace2blob.sh'
+config2header = 'config2header/main.py'
+nic_config = 'nic_config.h'
 packet_trace = 'packet_trace.csv'
 nic_simulator = 'nic_simulator/main.py'
 simulate = 1
 run_on_esp = 1
+coalesce = 0
+text_export = 0
+histograms = 0
+search = 0
+edf = 0
+pool = 0
+prio_boost = 0
+
+
+def export_overflows(line: str) -> int:
+    '''Results the firmware could not stream, from its '# export' statistics line.'''
+    if not line.startswith('# export '):
+        return 0
+    for field in line.split():
+        if field.startswith('overflows='):
+            return int(field[len('overflows='):])
+    return 0
+
 
 # You can also customize that when invoking the app.
 parser = argparse.ArgumentParser(description='Runs experiments.')
@@ -26,6 +50,20 @@ parser.add_argument('-p', default=standard_port, help='Sets the device port')
 parser.add_argument('-e', default=standard_path, help='Path to experiments folder')
 parser.add_argument('-s', default=simulate, help='Set 0 to skip NIC simulator')
 parser.add_argument('-b', default=run_on_esp, help='Set 0 to skip build and run on esp32')
+parser.add_argument('-c', default=coalesce, type=int,
+                    help='Set 1 to moderate interrupts on the esp32 instead of replaying the simulated IRQs')
+parser.add_argument('-t', default=text_export, type=int,
+                    help='Set 1 to stream results as csv text instead of binary frames (slower)')
+parser.add_argument('-g', default=histograms, type=int,
+                    help='Set 1 to only export per port latency and runtime histograms to ' + stats_file)
+parser.add_argument('-r', default=search, type=int,
+                    help='Set 1 to replay the trace at rising speed and report the sustainable rates to ' + stats_file)
+parser.add_argument('-d', default=edf, type=int,
+                    help='Set 1 to schedule the workers by earliest deadline instead of fixed priorities')
+parser.add_argument('-w', default=pool, type=int,
+                    help='Set 1 to serve all ports from a shared work stealing worker pool')
+parser.add_argument('-i', default=prio_boost, type=int,
+                    help='Set 1 to run each net task just above its highest priority waiting worker')
 args = parser.parse_args()
 
 # Export environment
@@ -44,13 +82,23 @@ for top, dirs, files in os.walk(root):
             os.system('python ' + nic_simulator + ' ' + top + '/' + packet_trace + ' --config ' + top +
                       '/config.json --irqout ' + trace_file_path + ' --seqout ' + top + '/sequence.csv')
 
-            # Create trace blob.
-            print("Creating blob from interrupt trace.")
-            os.system('cat ' + trace_file_path + ' | ' + trace2blob_path + ' > ' + top + '/trace.h')
+            # Create trace blob. On-device moderation replays every packet arrival as its own IRQ.
+            blob_source = top + '/' + packet_trace if args.c == 1 else trace_file_path
+            print("Creating blob from " + blob_source)
+            os.system('cat ' + blob_source + ' | ' + trace2blob_path + ' > ' + top + '/trace.h')
+
+            # Create firmware configuration header.
+            print("Creating firmware config from experiment config.")
+            os.system('python ' + config2header + ' ' + top + '/config.json --out ' + top + '/' + nic_config +
+                      (' --coalesce' if args.c == 1 else '') + (' --text-export' if args.t == 1 else '') +
+                      (' --histograms' if args.g == 1 else '') + (' --search' if args.r == 1 else '') +
+                      (' --edf' if args.d == 1 else '') + (' --pool' if args.w == 1 else '') +
+                      (' --prio-boost' if args.i == 1 else ''))
         if args.b == 1:
             # Copy trace blob to project.
             print("Copying trace blob to project folder")
             os.system('cp ' + top + '/trace.h' + ' ' + project_path + '/main/')
+            os.system('cp ' + top + '/' + nic_config + ' ' + project_path + '/main/')
 
             # Remove prior build.
             os.system('rm -r ' + project_path + '/build/')
@@ -62,10 +110,31 @@ for top, dirs, files in os.walk(root):
 
             # Define output file.
             output = open(top + '/' + output_file, 'w', newline='')
+            stats = open(top + '/' + stats_file, 'w')
             start_time = time.time()
+            overflows = 0
             # Contact serial port.
-            with Serial(args.p, 115200, timeout=60) as ser:
-                while True:
+            with Serial(args.p, baud_rate, timeout=60) as ser:
+                # Binary result frames, see result_stream.py.
+                stream = ResultStream()
+                while args.t != 1:
+                    stream.feed(ser.read(ser.in_waiting or 1))
+                    for row in stream.rows:
+                        output.write(format_row(row))
+                    for line in stream.lines:
+                        # Firmware statistics are prefixed with '#'.
+                        if line.startswith('#'):
+                            stats.write(line)
+                            overflows += export_overflows(line)
+                    stream.rows.clear()
+                    stream.lines.clear()
+                    if stream.done:
+                        print('%d corrupted result frames' % stream.corrupted)
+                        output.close()
+                        stats.close()
+                        break
+
+                while args.t == 1:
                     try:
                         line = ser.readline().decode("utf-8")
                     except ValueError:
@@ -74,10 +143,21 @@ for top, dirs, files in os.walk(root):
                     # Remove usual output.
                     if line.startswith('END'):
                         output.close()
+                        stats.close()
                         break
 
                     if line[:1].isdigit():
                         output.write(line)
+
+                    # Firmware statistics are prefixed with '#'.
+                    if line.startswith('#'):
+                        stats.write(line)
+                        overflows += export_overflows(line)
                 ser.__del__()
+
+            # Results lost in the firmware export ring leave gaps, do not keep them.
+            if overflows:
+                print('%d results overflowed the export ring, removing %s' % (overflows, output_file))
+                os.remove(top + '/' + output_file)
             print("--- %s seconds ---" % (time.time() - start_time))
 print("All experiments run successfully.")